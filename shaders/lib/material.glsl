@@ -9,6 +9,18 @@ struct Material {
     bool refractive;
 };
 
+// Entry of the scene's material table. Textures are multiplied by the factors, an id of -1 means no texture.
+struct MaterialData {
+    vec4 baseColorFactor;
+    vec3 emissiveFactor;
+    float metallicFactor;
+    float roughnessFactor;
+    int baseColorId;
+    int normalId;
+    int metallicRoughnessId;
+    int emissiveId;
+};
+
 vec3 getMaterialAlbedo(Material material) {
     return material.baseColor * (1.0 - material.metalness);
 }
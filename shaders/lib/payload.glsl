@@ -1,4 +1,5 @@
 #include "material.glsl"
+#include "raycone.glsl"
 
 struct Payload {
     uint objectId;
@@ -6,4 +7,6 @@ struct Payload {
     vec3 normal;
     mat3 tbn;
     Material material;
+    // Set by the caller to the cone of the traced ray, the hit shader replaces it with the cone at the hit point
+    RayCone cone;
 };
\ No newline at end of file
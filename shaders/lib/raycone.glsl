@@ -0,0 +1,36 @@
+#ifndef RAYCONE_GLSL
+#define RAYCONE_GLSL
+
+// Ray cones for texture LOD selection, based on "Improved Shader and Texture Level of Detail Using Ray Cones"
+// (Akenine-Möller et al. 2021). The cone is tracked by its width at the ray origin and its spread angle.
+
+struct RayCone {
+    float width;
+    float spread;
+};
+
+// Cone of a camera ray, the spread is the angle covered by a single pixel
+RayCone primaryRayCone(mat4 proj, float screenHeight) {
+    return RayCone(0.0, atan(2.0 / (proj[1][1] * screenHeight)));
+}
+
+RayCone propagateRayCone(RayCone cone, float hitDist) {
+    return RayCone(cone.width + cone.spread * hitDist, cone.spread);
+}
+
+// Widens the cone after scattering off a surface. Smooth surfaces keep it as it is, rough ones spread it roughly as
+// wide as their lobe, which keeps diffuse bounces on the coarse mips. Takes the squared GGX alpha the hit shader
+// stores in Material.roughness.
+RayCone bounceRayCone(RayCone cone, float alpha) {
+    return RayCone(cone.width, cone.spread + alpha);
+}
+
+// Texture independent part of the LOD: half the log of the texel to world area ratio of the triangle plus the cone
+// footprint. The texture size is added when sampling.
+float getRayConeLod(RayCone cone, float hitDist, float triangleLod, vec3 normal, vec3 direction) {
+    float width = abs(cone.width + cone.spread * hitDist);
+    float cosine = max(abs(dot(normal, direction)), 1e-4);
+    return triangleLod + log2(max(width, 1e-8)) - log2(cosine);
+}
+
+#endif // RAYCONE_GLSL
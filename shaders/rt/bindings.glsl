@@ -4,12 +4,13 @@
 #include "buffers.glsl"
 #include "objdesc.glsl"
 #include "vertex.glsl"
+#include "../lib/material.glsl"
 
 layout(set = 2, binding = 0) uniform accelerationStructureEXT tlas;
 
-layout(set = 2, binding = 1, scalar) buffer BufferAddresses {
-    ObjDesc o[];
-} addresses;
+layout(set = 2, binding = 1, scalar) buffer Instances {
+    InstanceDesc i[];
+} instances;
 
 layout(set = 2, binding = 2) uniform sampler2D textureSamplers[];
 
@@ -17,4 +18,23 @@ layout(set = 2, binding = 3) buffer EmissiveObjectIds {
     uint ids[];
 } emissiveObjects;
 
+layout(set = 2, binding = 4, scalar) buffer GeometryChunks {
+    GeometryChunk c[];
+} geometryChunks;
+
+layout(set = 2, binding = 5, scalar) buffer Materials {
+    MaterialData m[];
+} materials;
+
+// Finest level requested from each texture this frame, relative to its first resident level
+layout(set = 2, binding = 6) buffer TextureFeedback {
+    int requestedLevels[];
+} textureFeedback;
+
+layout(set = 2, binding = 7, scalar) buffer Geometries {
+    GeometryDesc g[];
+} geometries;
+
+#include "geometry.glsl"
+
 #endif
\ No newline at end of file
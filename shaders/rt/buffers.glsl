@@ -3,16 +3,24 @@
 
 #include "vertex.glsl"
 
+// Read as 32-bit words, models with 16-bit indices pack two of them into each word
 layout(buffer_reference, scalar) buffer Indices {
-    uvec3 i[];
+    uint i[];
 };
 
 layout(buffer_reference, scalar) buffer VertexData {
-    Vertex v[];
+    PackedVertex v[];
 };
 
 layout(buffer_reference, scalar) buffer PositionData {
     vec3 p[];
 };
 
+// One block of the geometry arena, models index into it with their first index word and first vertex
+struct GeometryChunk {
+    Indices indices;
+    PositionData positions;
+    VertexData vertices;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,141 @@
+#ifndef GEOMETRY_GLSL
+#define GEOMETRY_GLSL
+
+// Accessors for the scene geometry, expects the bindings from bindings.glsl to be declared
+
+#include "objdesc.glsl"
+
+struct HitData {
+    vec2 uv;
+    mat3 tbn;
+};
+
+ObjDesc getObjDesc(uint instanceId) {
+    InstanceDesc instance = instances.i[instanceId];
+    GeometryDesc geometry = geometries.g[instance.geometryId];
+    return ObjDesc(
+        instance.modelMatrix,
+        instance.normalMatrix,
+        geometry.triangleCount,
+        instance.materialId,
+        geometry.geometryChunk,
+        geometry.firstIndexWord,
+        geometry.firstVertex,
+        geometry.vertexFlags,
+        geometry.indexType
+    );
+}
+
+// Indices of the triangle's vertices, already offset to the model's range in the chunk
+uvec3 getTriangle(ObjDesc desc, uint triangleIndex) {
+    Indices indices = geometryChunks.c[desc.geometryChunk].indices;
+    uint firstIndex = 3u * triangleIndex;
+    uvec3 triangle;
+    if (desc.indexType == INDEX_TYPE_UINT16) {
+        // The triangle's three halves span two words, starting at either half of the first one
+        uint word = desc.firstIndexWord + firstIndex / 2u;
+        uint low = indices.i[word];
+        uint high = indices.i[word + 1u];
+        triangle = (firstIndex & 1u) == 0u
+            ? uvec3(low & 0xFFFFu, low >> 16u, high & 0xFFFFu)
+            : uvec3(low >> 16u, high & 0xFFFFu, high >> 16u);
+    } else {
+        uint word = desc.firstIndexWord + firstIndex;
+        triangle = uvec3(indices.i[word], indices.i[word + 1u], indices.i[word + 2u]);
+    }
+    return triangle + desc.firstVertex;
+}
+
+vec3 getPosition(ObjDesc desc, uint vertexIndex) {
+    return geometryChunks.c[desc.geometryChunk].positions.p[vertexIndex];
+}
+
+Vertex getVertex(ObjDesc desc, uint vertexIndex) {
+    return unpackVertex(geometryChunks.c[desc.geometryChunk].vertices.v[vertexIndex], desc.vertexFlags);
+}
+
+// Half the log2 of the triangle's UV to world space area ratio, the base of the ray cone texture LOD
+float getTriangleLod(ObjDesc desc, uvec3 index) {
+    vec3 p0 = getPosition(desc, index.x);
+    vec3 p1 = getPosition(desc, index.y);
+    vec3 p2 = getPosition(desc, index.z);
+    mat3 model = mat3(desc.modelMatrix);
+    float worldArea = length(cross(model * (p1 - p0), model * (p2 - p0)));
+
+    vec2 uv0 = getVertex(desc, index.x).uv;
+    vec2 uv1 = getVertex(desc, index.y).uv;
+    vec2 uv2 = getVertex(desc, index.z).uv;
+    vec2 e1 = uv1 - uv0;
+    vec2 e2 = uv2 - uv0;
+    float uvArea = abs(e1.x * e2.y - e1.y * e2.x);
+
+    return 0.5 * log2(max(uvArea, 1e-12) / max(worldArea, 1e-12));
+}
+
+// Samples a scene texture at a LOD from getRayConeLod, scaled to the texture's resolution
+// Mip 0 of a scene texture is its first resident level, so the size already accounts for the missing levels
+vec4 sampleSceneTexture(int textureId, vec2 uv, float lod) {
+    vec2 size = vec2(textureSize(textureSamplers[nonuniformEXT(textureId)], 0));
+    float level = lod + 0.5 * log2(size.x * size.y);
+    int requestedLevel = int(floor(level));
+    if (requestedLevel < textureFeedback.requestedLevels[textureId]) {
+        atomicMin(textureFeedback.requestedLevels[textureId], requestedLevel);
+    }
+    return textureLod(textureSamplers[nonuniformEXT(textureId)], uv, level);
+}
+
+vec2 getUV(ObjDesc desc, uvec3 index, vec3 baryCoords) {
+    vec2 uv0 = getVertex(desc, index.x).uv;
+    vec2 uv1 = getVertex(desc, index.y).uv;
+    vec2 uv2 = getVertex(desc, index.z).uv;
+    return baryCoords.x * uv0 + baryCoords.y * uv1 + baryCoords.z * uv2;
+}
+
+// The vertices are in object space, the returned basis is in world space
+HitData getHitData(ObjDesc desc, uvec3 index, vec3 baryCoords) {
+    vec3 vertPos0 = getPosition(desc, index.x);
+    vec3 vertPos1 = getPosition(desc, index.y);
+    vec3 vertPos2 = getPosition(desc, index.z);
+
+    vec3 edge1 = vertPos1 - vertPos0;
+    vec3 edge2 = vertPos2 - vertPos0;
+
+    // Every vertex is fetched and unpacked once
+    Vertex vertex0 = getVertex(desc, index.x);
+    Vertex vertex1 = getVertex(desc, index.y);
+    Vertex vertex2 = getVertex(desc, index.z);
+
+    vec2 uv = baryCoords.x * vertex0.uv + baryCoords.y * vertex1.uv + baryCoords.z * vertex2.uv;
+
+    vec3 normal = vertex0.normal * baryCoords.x + vertex1.normal * baryCoords.y + vertex2.normal * baryCoords.z;
+    float normalLen = length(normal);
+    if (normalLen < 0.01) {
+        normal = normalize(cross(edge1, edge2));
+    } else {
+        normal /= normalLen;
+    }
+
+    vec3 tangent = vertex0.tangent * baryCoords.x + vertex1.tangent * baryCoords.y + vertex2.tangent * baryCoords.z;
+    float tangentLen = length(tangent);
+    if (tangentLen < 0.01) {
+        vec2 deltaUV1 = vertex1.uv - vertex0.uv;
+        vec2 deltaUV2 = vertex2.uv - vertex0.uv;
+        float scaleFactor = 1.0 / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
+        tangent = normalize(scaleFactor * (deltaUV2.y * edge1 - deltaUV1.y * edge2));
+    } else {
+        tangent /= tangentLen;
+    }
+
+    normal = normalize(desc.normalMatrix * normal);
+    tangent = normalize(mat3(desc.modelMatrix) * tangent);
+    // A mirroring transform flips the handedness of the tangent space
+    float mirrorSign = determinant(mat3(desc.modelMatrix)) < 0.0 ? -1.0 : 1.0;
+    vec3 bitangent = mirrorSign * vertex0.bitangentSign * normalize(cross(tangent, normal));
+
+    return HitData(
+        uv,
+        mat3(tangent, bitangent, normal)
+    );
+}
+
+#endif
\ No newline at end of file
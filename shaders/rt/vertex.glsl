@@ -1,11 +1,39 @@
 #ifndef VERTEX_GLSL
 #define VERTEX_GLSL
 
+// Layout of VertexData in src/content/MeshData.h
+struct PackedVertex {
+    uint uv;
+    uint normal;
+    uint tangent;
+};
+
 struct Vertex {
     vec2 uv;
     vec3 normal;
     vec3 tangent;
+    float bitangentSign;
 };
 
-#endif
+// Same as the flags in src/content/MeshData.h, missing attributes decode to zero vectors
+const uint VERTEX_HAS_NORMALS = 1u;
+const uint VERTEX_HAS_TANGENTS = 2u;
 
+vec3 octahedralDecode(vec2 encoded) {
+    vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-direction.z, 0.0);
+    direction.x += direction.x >= 0.0 ? -fold : fold;
+    direction.y += direction.y >= 0.0 ? -fold : fold;
+    return normalize(direction);
+}
+
+Vertex unpackVertex(PackedVertex packed, uint flags) {
+    Vertex vertex;
+    vertex.uv = unpackHalf2x16(packed.uv);
+    vertex.normal = (flags & VERTEX_HAS_NORMALS) != 0u ? octahedralDecode(unpackSnorm2x16(packed.normal)) : vec3(0.0);
+    vertex.tangent = (flags & VERTEX_HAS_TANGENTS) != 0u ? octahedralDecode(unpackSnorm2x16(packed.tangent & ~1u)) : vec3(0.0);
+    vertex.bitangentSign = (packed.tangent & 1u) != 0u ? -1.0 : 1.0;
+    return vertex;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+namespace rendering {
+
+    // Highest resident set size of the process so far in bytes, or 0 if the platform doesn't report it
+    uint64_t getPeakMemoryUsage();
+
+}  // namespace rendering
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace rendering {
+
+    /*
+     * Fixed-size pool of worker threads. Tasks must not block on the futures of other tasks submitted to the same
+     * pool, otherwise the pool can deadlock once every worker is waiting.
+     */
+    class ThreadPool {
+    public:
+        explicit ThreadPool(uint32_t threadCount = std::thread::hardware_concurrency());
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        template<typename F>
+        auto submit(F &&func) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+            using Result = std::invoke_result_t<std::decay_t<F>>;
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(func));
+            auto future = task->get_future();
+            {
+                std::lock_guard lock(mutex);
+                tasks.emplace([task]() { (*task)(); });
+            }
+            condition.notify_one();
+            return future;
+        }
+
+        [[nodiscard]] uint32_t size() const;
+
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping = false;
+
+        void workerLoop();
+    };
+
+}  // namespace rendering
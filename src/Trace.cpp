@@ -0,0 +1,157 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include "json.hpp"
+
+namespace rendering {
+
+namespace {
+
+struct TraceEvent {
+    const char *name;
+    uint32_t threadIndex;
+    // Microseconds since the start of the trace
+    int64_t start;
+    int64_t duration;
+};
+
+std::atomic<bool> tracingEnabled = false;
+std::chrono::steady_clock::time_point traceStart;
+std::mutex eventsMutex;
+std::vector<TraceEvent> events;
+
+// Small sequential ids read better in the trace viewers than hashed std::thread::ids
+uint32_t getThreadIndex() {
+    static std::atomic<uint32_t> nextIndex = 0;
+    thread_local const uint32_t index = nextIndex++;
+    return index;
+}
+
+int64_t toMicroseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+}  // namespace
+
+void enableTracing() {
+    getThreadIndex();
+    traceStart = std::chrono::steady_clock::now();
+    tracingEnabled.store(true, std::memory_order_release);
+}
+
+void disableTracing() {
+    tracingEnabled.store(false, std::memory_order_release);
+    std::lock_guard lock(eventsMutex);
+    std::vector<TraceEvent>().swap(events);
+}
+
+bool isTracingEnabled() {
+    return tracingEnabled.load(std::memory_order_acquire);
+}
+
+void writeChromeTrace(const std::string &path) {
+    std::lock_guard lock(eventsMutex);
+    auto traceEvents = nlohmann::json::array();
+    std::set<uint32_t> threadIndices;
+    for (const auto &event : events) {
+        traceEvents.push_back({
+            {"name", event.name},
+            {"cat", "startup"},
+            {"ph", "X"},
+            {"ts", event.start},
+            {"dur", event.duration},
+            {"pid", 0},
+            {"tid", event.threadIndex},
+        });
+        threadIndices.insert(event.threadIndex);
+    }
+    for (const auto threadIndex : threadIndices) {
+        traceEvents.push_back({
+            {"name", "thread_name"},
+            {"ph", "M"},
+            {"pid", 0},
+            {"tid", threadIndex},
+            {"args", {{"name", threadIndex == 0 ? std::string("Main") : "Worker " + std::to_string(threadIndex)}}},
+        });
+    }
+
+    std::ofstream output(path);
+    if (!output) {
+        throw std::runtime_error("Failed to open trace file " + path);
+    }
+    output << nlohmann::json{{"traceEvents", traceEvents}, {"displayTimeUnit", "ms"}}.dump();
+    std::cout << "Wrote " << events.size() << " trace events to " << path << "\n";
+}
+
+void printTraceSummary() {
+    struct PhaseSummary {
+        uint64_t count = 0;
+        int64_t total = 0;
+        int64_t max = 0;
+        std::set<uint32_t> threads;
+    };
+
+    std::map<std::string, PhaseSummary> phases;
+    {
+        std::lock_guard lock(eventsMutex);
+        for (const auto &event : events) {
+            auto &phase = phases[event.name];
+            phase.count++;
+            phase.total += event.duration;
+            phase.max = std::max(phase.max, event.duration);
+            phase.threads.insert(event.threadIndex);
+        }
+    }
+
+    // Busiest phases first, totals add up the time of every thread so they can exceed the wall clock
+    std::vector<std::pair<std::string, PhaseSummary>> sorted(phases.begin(), phases.end());
+    std::ranges::sort(sorted, [](const auto &a, const auto &b) { return a.second.total > b.second.total; });
+
+    std::cout << std::left << std::setw(32) << "Phase" << std::right << std::setw(10) << "Count" << std::setw(14)
+              << "Total ms" << std::setw(12) << "Mean ms" << std::setw(12) << "Max ms" << std::setw(10) << "Threads"
+              << "\n";
+    std::cout << std::fixed << std::setprecision(2);
+    for (const auto &[name, phase] : sorted) {
+        std::cout << std::left << std::setw(32) << name << std::right << std::setw(10) << phase.count << std::setw(14)
+                  << phase.total / 1000.0 << std::setw(12) << phase.total / 1000.0 / phase.count << std::setw(12)
+                  << phase.max / 1000.0 << std::setw(10) << phase.threads.size() << "\n";
+    }
+    std::cout << std::defaultfloat;
+}
+
+TraceScope::TraceScope(const char *name) : name(name), enabled(isTracingEnabled()) {
+    if (enabled) {
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+TraceScope::~TraceScope() {
+    if (!enabled) {
+        return;
+    }
+    const auto end = std::chrono::steady_clock::now();
+    TraceEvent event{
+        name,
+        getThreadIndex(),
+        toMicroseconds(start - traceStart),
+        toMicroseconds(end - start),
+    };
+    std::lock_guard lock(eventsMutex);
+    // Scopes that began before disableTracing end after it, the trace they belonged to is gone
+    if (isTracingEnabled()) {
+        events.push_back(event);
+    }
+}
+
+}  // namespace rendering
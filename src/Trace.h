@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+namespace rendering {
+
+    // Starts recording trace scopes, the calling thread is listed as the main thread
+    void enableTracing();
+
+    // Stops recording and drops the recorded scopes, scopes still open when this is called are dropped as well
+    void disableTracing();
+
+    [[nodiscard]] bool isTracingEnabled();
+
+    // Writes every scope recorded so far in the Chrome trace event format, viewable in chrome://tracing or Perfetto
+    void writeChromeTrace(const std::string &path);
+
+    // Prints the count, inclusive total, mean and maximum duration of every scope name
+    void printTraceSummary();
+
+    /*
+     * Records the time between its construction and destruction on the current thread. The name has to outlive the
+     * trace, use string literals. While tracing is disabled a scope only reads a flag.
+     */
+    class TraceScope {
+    public:
+        explicit TraceScope(const char *name);
+
+        ~TraceScope();
+
+        TraceScope(const TraceScope &) = delete;
+
+        TraceScope &operator=(const TraceScope &) = delete;
+
+    private:
+        const char *name;
+        bool enabled;
+        std::chrono::steady_clock::time_point start;
+    };
+
+}  // namespace rendering
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) rendering::TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -1,19 +1,26 @@
 #include "AccelerationStructure.h"
 
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "Trace.h"
 #include "util.h"
 
 namespace rendering {
+    // Only creates the structure, it has to be built with build() or buildBatched() before use
     AccelerationStructure::AccelerationStructure(
             VulkanContext &context,
             vk::AccelerationStructureGeometryKHR geometry,
             uint32_t primitiveCount,
-            vk::AccelerationStructureTypeKHR type
+            vk::AccelerationStructureTypeKHR type,
+            vk::BuildAccelerationStructureFlagsKHR flags
     )
             : geometry(geometry) {
         buildGeometryInfo =
                 vk::AccelerationStructureBuildGeometryInfoKHR{
                         type,
-                        vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace,
+                        flags,
                         vk::BuildAccelerationStructureModeKHR::eBuild,
                         {},
                         {},
@@ -24,6 +31,8 @@ namespace rendering {
                 vk::AccelerationStructureBuildTypeKHR::eDevice, buildGeometryInfo, primitiveCount
         );
         scratchBufferSize = buildSizesInfo.buildScratchSize;
+        updateScratchBufferSize = buildSizesInfo.updateScratchSize;
+        accelerationStructureSize = buildSizesInfo.accelerationStructureSize;
 
         accelerationStructureBuffer = std::make_unique<Buffer>(
                 context,
@@ -41,20 +50,221 @@ namespace rendering {
         buildRangeInfo = vk::AccelerationStructureBuildRangeInfoKHR{primitiveCount, 0, 0, 0};
 
         accelInfo = vk::WriteDescriptorSetAccelerationStructureKHR{1, &*accelerationStructure};
+    }
 
-        Buffer buffer = createScratchBuffer(context);
-        buildGeometryInfo.scratchData = {alignUp(buffer.deviceAddress(), 128)};
+    void AccelerationStructure::build(VulkanContext &context) {
+        TRACE_SCOPE("Build acceleration structure");
+        buildGeometryInfo.scratchData = {getScratchAddress(context)};
         context.createAndSubmitCommandBuffer(
                 [&](vk::CommandBuffer cmd) { cmd.buildAccelerationStructuresKHR(buildGeometryInfo, &buildRangeInfo); },
                 false
         );
     }
 
-    Buffer AccelerationStructure::createScratchBuffer(VulkanContext &context) const {
-        return {
+    void AccelerationStructure::update(VulkanContext &context) {
+        TRACE_SCOPE("Refit acceleration structure");
+        const auto updateGeometryInfo = getUpdateInfo(getScratchAddress(context));
+        context.createAndSubmitCommandBuffer(
+                [&](vk::CommandBuffer cmd) { cmd.buildAccelerationStructuresKHR(updateGeometryInfo, &buildRangeInfo); },
+                false
+        );
+    }
+
+    vk::AccelerationStructureBuildGeometryInfoKHR AccelerationStructure::getUpdateInfo(
+            vk::DeviceAddress scratchAddress
+    ) const {
+        auto updateGeometryInfo = buildGeometryInfo;
+        updateGeometryInfo.mode = vk::BuildAccelerationStructureModeKHR::eUpdate;
+        updateGeometryInfo.srcAccelerationStructure = *accelerationStructure;
+        updateGeometryInfo.scratchData = {scratchAddress};
+        return updateGeometryInfo;
+    }
+
+    void AccelerationStructure::buildBatched(
+            VulkanContext &context,
+            std::span<AccelerationStructure *const> structures
+    ) {
+        TRACE_SCOPE("Build BLASes");
+        if (structures.empty()) {
+            return;
+        }
+
+        const uint64_t scratchAlignment = getScratchAlignment(context);
+
+        // Split the builds so a single batch never needs more scratch memory than the budget, unless one build alone
+        // exceeds it, in which case it gets a batch of its own
+        struct Batch {
+            size_t begin;
+            size_t end;
+        };
+        std::vector<Batch> batches;
+        std::vector<uint64_t> scratchOffsets(structures.size());
+        uint64_t arenaSize = 0;
+        uint64_t batchSize = 0;
+        for (size_t i = 0; i < structures.size(); i++) {
+            const auto size = alignUp(structures[i]->scratchBufferSize, scratchAlignment);
+            if (batches.empty() || (batchSize > 0 && batchSize + size > MAX_BATCH_SCRATCH_SIZE)) {
+                batches.push_back({i, i});
+                batchSize = 0;
+            }
+            scratchOffsets[i] = batchSize;
+            batchSize += size;
+            batches.back().end = i + 1;
+            arenaSize = std::max(arenaSize, batchSize);
+        }
+
+        Buffer scratchArena(
                 context,
-                scratchBufferSize + 128,
+                arenaSize + scratchAlignment,
                 vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress
+        );
+        const auto scratchBase = alignUp(scratchArena.deviceAddress(), scratchAlignment);
+
+        std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos;
+        std::vector<const vk::AccelerationStructureBuildRangeInfoKHR *> buildRangeInfos;
+        buildGeometryInfos.reserve(structures.size());
+        buildRangeInfos.reserve(structures.size());
+        for (size_t i = 0; i < structures.size(); i++) {
+            structures[i]->buildGeometryInfo.scratchData = {scratchBase + scratchOffsets[i]};
+            buildGeometryInfos.push_back(structures[i]->buildGeometryInfo);
+            buildRangeInfos.push_back(&structures[i]->buildRangeInfo);
+        }
+
+        context.createAndSubmitCommandBuffer([&](vk::CommandBuffer cmd) {
+            for (size_t i = 0; i < batches.size(); i++) {
+                if (i > 0) {
+                    // The previous batch has to finish with the arena before the next one overwrites it
+                    const vk::MemoryBarrier barrier{
+                            vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+                            vk::AccessFlagBits::eAccelerationStructureReadKHR |
+                                    vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+                    };
+                    cmd.pipelineBarrier(
+                            vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                            vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                            {},
+                            barrier,
+                            {},
+                            {}
+                    );
+                }
+                const auto count = static_cast<uint32_t>(batches[i].end - batches[i].begin);
+                cmd.buildAccelerationStructuresKHR(
+                        count,
+                        buildGeometryInfos.data() + batches[i].begin,
+                        buildRangeInfos.data() + batches[i].begin
+                );
+            }
+        });
+
+        std::cout << "Built " << structures.size() << " acceleration structures in " << batches.size()
+                  << " batches using " << arenaSize / (1024 * 1024) << " MiB of scratch memory\n";
+    }
+
+    void AccelerationStructure::compact(VulkanContext &context, std::span<AccelerationStructure *const> structures) {
+        TRACE_SCOPE("Compact BLASes");
+        if (structures.empty()) {
+            return;
+        }
+        const auto count = static_cast<uint32_t>(structures.size());
+
+        const vk::QueryPoolCreateInfo queryPoolCreateInfo{
+                {},
+                vk::QueryType::eAccelerationStructureCompactedSizeKHR,
+                count,
         };
+        const auto queryPool = context.device->createQueryPoolUnique(queryPoolCreateInfo);
+
+        std::vector<vk::AccelerationStructureKHR> handles;
+        handles.reserve(structures.size());
+        for (const auto *structure : structures) {
+            handles.push_back(*structure->accelerationStructure);
+        }
+        context.createAndSubmitCommandBuffer([&](vk::CommandBuffer cmd) {
+            cmd.resetQueryPool(*queryPool, 0, count);
+            cmd.writeAccelerationStructuresPropertiesKHR(
+                    handles, vk::QueryType::eAccelerationStructureCompactedSizeKHR, *queryPool, 0
+            );
+        });
+        const auto queryResults = context.device->getQueryPoolResults<vk::DeviceSize>(
+                *queryPool,
+                0,
+                count,
+                count * sizeof(vk::DeviceSize),
+                sizeof(vk::DeviceSize),
+                vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait
+        );
+        if (queryResults.result != vk::Result::eSuccess) {
+            throw std::runtime_error("Failed to query compacted acceleration structure sizes");
+        }
+        const auto &compactedSizes = queryResults.value;
+
+        std::vector<std::unique_ptr<Buffer>> compactedBuffers;
+        std::vector<vk::UniqueAccelerationStructureKHR> compactedStructures;
+        compactedBuffers.reserve(structures.size());
+        compactedStructures.reserve(structures.size());
+        uint64_t originalSize = 0;
+        uint64_t compactedSize = 0;
+        for (size_t i = 0; i < structures.size(); i++) {
+            const auto &structure = *structures[i];
+            compactedBuffers.push_back(std::make_unique<Buffer>(
+                    context,
+                    compactedSizes[i],
+                    vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR |
+                            vk::BufferUsageFlagBits::eShaderDeviceAddress
+            ));
+            const vk::AccelerationStructureCreateInfoKHR createInfo{
+                    {}, *compactedBuffers.back()->buffer, {}, compactedSizes[i], structure.buildGeometryInfo.type
+            };
+            compactedStructures.push_back(context.device->createAccelerationStructureKHRUnique(createInfo));
+            originalSize += structure.accelerationStructureSize;
+            compactedSize += compactedSizes[i];
+        }
+
+        context.createAndSubmitCommandBuffer([&](vk::CommandBuffer cmd) {
+            for (size_t i = 0; i < structures.size(); i++) {
+                const vk::CopyAccelerationStructureInfoKHR copyInfo{
+                        handles[i], *compactedStructures[i], vk::CopyAccelerationStructureModeKHR::eCompact
+                };
+                cmd.copyAccelerationStructureKHR(copyInfo);
+            }
+        });
+
+        // The copies have finished, the originals can go
+        for (size_t i = 0; i < structures.size(); i++) {
+            auto &structure = *structures[i];
+            structure.accelerationStructure = std::move(compactedStructures[i]);
+            structure.accelerationStructureBuffer = std::move(compactedBuffers[i]);
+            structure.accelerationStructureSize = compactedSizes[i];
+            structure.buildGeometryInfo.dstAccelerationStructure = *structure.accelerationStructure;
+        }
+
+        std::cout << "Compacted " << structures.size() << " acceleration structures from "
+                  << originalSize / (1024 * 1024) << " MiB to " << compactedSize / (1024 * 1024) << " MiB, saved "
+                  << (originalSize - compactedSize) / (1024 * 1024) << " MiB\n";
+    }
+
+    vk::DeviceAddress AccelerationStructure::getScratchAddress(VulkanContext &context) {
+        // The sizes are fixed at creation, so the buffer is allocated once and reused by every later build and refit
+        const uint64_t scratchAlignment = getScratchAlignment(context);
+        if (!scratchBuffer) {
+            scratchBuffer = std::make_unique<Buffer>(
+                    context,
+                    std::max(scratchBufferSize, updateScratchBufferSize) + scratchAlignment,
+                    vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress
+            );
+        }
+        return alignUp(scratchBuffer->deviceAddress(), scratchAlignment);
+    }
+
+    uint64_t AccelerationStructure::getScratchAlignment(VulkanContext &context) {
+        const auto properties = context.physicalDevice.getProperties2<
+                vk::PhysicalDeviceProperties2,
+                vk::PhysicalDeviceAccelerationStructurePropertiesKHR>();
+        return std::max<uint64_t>(
+                properties.get<vk::PhysicalDeviceAccelerationStructurePropertiesKHR>()
+                        .minAccelerationStructureScratchOffsetAlignment,
+                128
+        );
     }
 }  // namespace rendering
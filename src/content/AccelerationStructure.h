@@ -3,12 +3,16 @@
 #include "VulkanContext.h"
 
 #include <memory>
+#include <span>
 #include <vulkan/vulkan.hpp>
 
 #include "Buffer.h"
 
 namespace rendering {
 
+    // Upper bound on the scratch memory shared by a batch of builds in AccelerationStructure::buildBatched
+    constexpr uint64_t MAX_BATCH_SCRATCH_SIZE = 256 * 1024 * 1024;
+
     class AccelerationStructure {
     public:
         std::unique_ptr<Buffer> accelerationStructureBuffer;
@@ -17,20 +21,56 @@ namespace rendering {
         vk::AccelerationStructureGeometryKHR geometry;
         vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo;
         vk::AccelerationStructureBuildRangeInfoKHR buildRangeInfo;
-        uint32_t scratchBufferSize;
+        vk::DeviceSize scratchBufferSize;
+        vk::DeviceSize updateScratchBufferSize;
+        vk::DeviceSize accelerationStructureSize;
 
         AccelerationStructure(
                 VulkanContext &context,
                 vk::AccelerationStructureGeometryKHR geometry,
                 uint32_t primitiveCount,
-                vk::AccelerationStructureTypeKHR type
+                vk::AccelerationStructureTypeKHR type,
+                vk::BuildAccelerationStructureFlagsKHR flags
         );
 
-        Buffer createScratchBuffer(VulkanContext &context) const;
+        // Builds this structure on its own with a dedicated scratch buffer
+        void build(VulkanContext &context);
+
+        /*
+         * Refits the built structure in place to the current contents of its inputs. Keeps the hierarchy of the last
+         * build, so the quality drops as the inputs move away from it. Only structures created with the eAllowUpdate
+         * flag can be refit, and the primitive count has to stay the same.
+         */
+        void update(VulkanContext &context);
+
+        // Build info that refits the structure in place, for recording the refit into a larger submission
+        [[nodiscard]] vk::AccelerationStructureBuildGeometryInfoKHR getUpdateInfo(vk::DeviceAddress scratchAddress) const;
+
+        /*
+         * Records the builds of every structure into a single submission. The structures are split into batches whose
+         * combined scratch size fits the budget, each batch suballocates a shared scratch arena and batches are
+         * separated by barriers so the next one can reuse the arena.
+         */
+        static void buildBatched(VulkanContext &context, std::span<AccelerationStructure *const> structures);
+
+        /*
+         * Queries the compacted sizes of already built structures, copies each of them into a tightly sized buffer and
+         * frees the originals. Only structures created with the eAllowCompaction flag can be compacted.
+         */
+        static void compact(VulkanContext &context, std::span<AccelerationStructure *const> structures);
 
         AccelerationStructure(const AccelerationStructure &) = delete;
 
         AccelerationStructure &operator=(const AccelerationStructure &) = delete;
+
+    private:
+        // Kept for the structures that are rebuilt or refit every frame, sized for both kinds of build
+        std::unique_ptr<Buffer> scratchBuffer;
+
+        vk::DeviceAddress getScratchAddress(VulkanContext &context);
+
+        // The device's scratch offset alignment, never less than 128 bytes
+        static uint64_t getScratchAlignment(VulkanContext &context);
     };
 
 }
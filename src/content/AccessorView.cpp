@@ -0,0 +1,172 @@
+#include "AccessorView.h"
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+#include "Hash.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RT_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace rendering {
+
+RawAccessor RawAccessor::fromGLTF(const tinygltf::Model &model, int32_t accessorIndex) {
+    const auto &accessor = model.accessors.at(accessorIndex);
+    if (accessor.bufferView < 0) {
+        // Sparse-only accessors are initialized to zeros, which is what an empty attribute gets too
+        return {};
+    }
+    const auto &bufferView = model.bufferViews.at(accessor.bufferView);
+    const auto &buffer = model.buffers.at(bufferView.buffer);
+
+    const auto stride = accessor.ByteStride(bufferView);
+    if (stride <= 0) {
+        throw std::runtime_error("Invalid accessor stride");
+    }
+
+    RawAccessor raw{
+        .data = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset,
+        .count = accessor.count,
+        .stride = static_cast<size_t>(stride),
+        .componentType = accessor.componentType,
+        .componentCount = tinygltf::GetNumComponentsInType(accessor.type),
+    };
+
+    const auto elementSize =
+        static_cast<size_t>(tinygltf::GetComponentSizeInBytes(raw.componentType) * raw.componentCount);
+    const auto begin = bufferView.byteOffset + accessor.byteOffset;
+    if (raw.count > 0 && begin + (raw.count - 1) * raw.stride + elementSize > buffer.data.size()) {
+        throw std::runtime_error("Accessor reads past the end of its buffer");
+    }
+    return raw;
+}
+
+uint64_t RawAccessor::hash(uint64_t seed) const {
+    const uint64_t layout[] = {count, stride, static_cast<uint64_t>(componentType), static_cast<uint64_t>(componentCount)};
+    auto result = hashBytes(layout, sizeof(layout), seed);
+    if (count > 0) {
+        const auto elementSize = static_cast<size_t>(tinygltf::GetComponentSizeInBytes(componentType) * componentCount);
+        result = hashBytes(data, (count - 1) * stride + elementSize, result);
+    }
+    return result;
+}
+
+template <typename Index>
+void widenStrided(const RawAccessor &accessor, uint32_t *destination) {
+    for (size_t i = 0; i < accessor.count; i++) {
+        Index index;
+        std::memcpy(&index, accessor.data + i * accessor.stride, sizeof(Index));
+        destination[i] = index;
+    }
+}
+
+template <typename Component>
+float readComponent(const uint8_t *data, bool normalized) {
+    Component value;
+    std::memcpy(&value, data, sizeof(Component));
+    if constexpr (std::is_floating_point_v<Component>) {
+        return value;
+    } else {
+        if (!normalized) {
+            return static_cast<float>(value);
+        }
+        // Signed values use the symmetric mapping glTF specifies, the lowest value clamps to -1
+        return std::max(static_cast<float>(value) / static_cast<float>(std::numeric_limits<Component>::max()), -1.0f);
+    }
+}
+
+glm::vec4 readVec4(const RawAccessor &accessor, size_t index, bool normalized) {
+    glm::vec4 result(0.0f);
+    const auto componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+    const auto *element = accessor.data + index * accessor.stride;
+    for (int i = 0; i < std::min(accessor.componentCount, 4); i++) {
+        const auto *data = element + i * componentSize;
+        switch (accessor.componentType) {
+            case TINYGLTF_COMPONENT_TYPE_FLOAT:
+                result[i] = readComponent<float>(data, normalized);
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                result[i] = readComponent<uint8_t>(data, normalized);
+                break;
+            case TINYGLTF_COMPONENT_TYPE_BYTE:
+                result[i] = readComponent<int8_t>(data, normalized);
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                result[i] = readComponent<uint16_t>(data, normalized);
+                break;
+            case TINYGLTF_COMPONENT_TYPE_SHORT:
+                result[i] = readComponent<int16_t>(data, normalized);
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+                result[i] = readComponent<uint32_t>(data, normalized);
+                break;
+            default:
+                throw std::runtime_error("Unsupported component type: " + std::to_string(accessor.componentType));
+        }
+    }
+    return result;
+}
+
+void widenIndices(const RawAccessor &accessor, uint32_t *destination) {
+    const auto tightlyPacked = accessor.isTightlyPacked();
+    switch (accessor.componentType) {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            if (tightlyPacked) {
+                std::memcpy(destination, accessor.data, accessor.count * sizeof(uint32_t));
+            } else {
+                widenStrided<uint32_t>(accessor, destination);
+            }
+            return;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+            if (!tightlyPacked) {
+                widenStrided<uint16_t>(accessor, destination);
+                return;
+            }
+            size_t i = 0;
+#ifdef RT_USE_SSE2
+            const auto zero = _mm_setzero_si128();
+            for (; i + 8 <= accessor.count; i += 8) {
+                const auto packed = _mm_loadu_si128(reinterpret_cast<const __m128i *>(accessor.data + i * 2));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), _mm_unpacklo_epi16(packed, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i + 4), _mm_unpackhi_epi16(packed, zero));
+            }
+#endif
+            for (; i < accessor.count; i++) {
+                uint16_t index;
+                std::memcpy(&index, accessor.data + i * 2, sizeof(uint16_t));
+                destination[i] = index;
+            }
+            return;
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+            if (!tightlyPacked) {
+                widenStrided<uint8_t>(accessor, destination);
+                return;
+            }
+            size_t i = 0;
+#ifdef RT_USE_SSE2
+            const auto zero = _mm_setzero_si128();
+            for (; i + 16 <= accessor.count; i += 16) {
+                const auto packed = _mm_loadu_si128(reinterpret_cast<const __m128i *>(accessor.data + i));
+                const auto low = _mm_unpacklo_epi8(packed, zero);
+                const auto high = _mm_unpackhi_epi8(packed, zero);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), _mm_unpacklo_epi16(low, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i + 4), _mm_unpackhi_epi16(low, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i + 8), _mm_unpacklo_epi16(high, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i + 12), _mm_unpackhi_epi16(high, zero));
+            }
+#endif
+            for (; i < accessor.count; i++) {
+                destination[i] = accessor.data[i];
+            }
+            return;
+        }
+        default:
+            throw std::runtime_error("Unsupported index component type: " + std::to_string(accessor.componentType));
+    }
+}
+
+}  // namespace rendering
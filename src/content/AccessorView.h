@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <stdexcept>
+
+#include "tiny_gltf.h"
+
+namespace rendering {
+
+    // Non-owning, strided window into the buffer an accessor points at. Stays valid as long as the model does.
+    struct RawAccessor {
+        const uint8_t *data = nullptr;
+        size_t count = 0;
+        size_t stride = 0;
+        int componentType = -1;
+        int componentCount = 0;
+
+        static RawAccessor fromGLTF(const tinygltf::Model &model, int32_t accessorIndex);
+
+        [[nodiscard]] bool empty() const {
+            return count == 0;
+        }
+
+        // Hashes the layout and every byte the accessor covers
+        [[nodiscard]] uint64_t hash(uint64_t seed) const;
+
+        [[nodiscard]] bool isTightlyPacked() const {
+            return stride == static_cast<size_t>(tinygltf::GetComponentSizeInBytes(componentType) * componentCount);
+        }
+    };
+
+    // Typed view over float attributes. Elements are memcpy-d out, so unaligned strides are fine.
+    template<typename T>
+    class AccessorView {
+    public:
+        AccessorView() = default;
+
+        explicit AccessorView(const RawAccessor &raw) : raw(raw) {
+            if (!raw.empty() && (raw.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT ||
+                                 raw.componentCount * sizeof(float) < sizeof(T))) {
+                throw std::runtime_error("Accessor format doesn't match the requested attribute type");
+            }
+        }
+
+        AccessorView(const tinygltf::Model &model, int32_t accessorIndex)
+                : AccessorView(RawAccessor::fromGLTF(model, accessorIndex)) {
+        }
+
+        T operator[](size_t index) const {
+            T value;
+            std::memcpy(&value, raw.data + index * raw.stride, sizeof(T));
+            return value;
+        }
+
+        [[nodiscard]] size_t size() const {
+            return raw.count;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return raw.empty();
+        }
+
+        [[nodiscard]] const RawAccessor &getRaw() const {
+            return raw;
+        }
+
+        // Copies the first `count` elements into `destination`, placing them `destinationStride` bytes apart
+        void copyTo(void *destination, size_t destinationStride, size_t count) const {
+            auto *out = static_cast<uint8_t *>(destination);
+            if (raw.stride == sizeof(T) && destinationStride == sizeof(T)) {
+                std::memcpy(out, raw.data, count * sizeof(T));
+                return;
+            }
+            for (size_t i = 0; i < count; i++) {
+                std::memcpy(out + i * destinationStride, raw.data + i * raw.stride, sizeof(T));
+            }
+        }
+
+    private:
+        RawAccessor raw;
+    };
+
+    /*
+     * Reads a single element of any component type, missing components are zero. Integer components are mapped to
+     * [0, 1] or [-1, 1] when normalized, like glTF weights and quantized keyframes, otherwise converted as they are,
+     * like joint indices.
+     */
+    glm::vec4 readVec4(const RawAccessor &accessor, size_t index, bool normalized);
+
+    // Widens 8, 16 or 32-bit indices into `destination`, which must have room for `accessor.count` elements
+    void widenIndices(const RawAccessor &accessor, uint32_t *destination);
+
+}  // namespace rendering
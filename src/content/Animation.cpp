@@ -0,0 +1,363 @@
+#include "Animation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/matrix.hpp>
+#include <stdexcept>
+
+#include "AccessorView.h"
+#include "Trace.h"
+
+namespace rendering {
+
+namespace {
+
+RawAccessor getAttribute(const tinygltf::Model &model, const std::map<std::string, int> &attributes, const std::string &name) {
+    const auto it = attributes.find(name);
+    return it == attributes.end() ? RawAccessor{} : RawAccessor::fromGLTF(model, it->second);
+}
+
+// Every component of every element, converted to floats
+std::vector<float> readFloats(const tinygltf::Model &model, int32_t accessorIndex) {
+    const auto accessor = RawAccessor::fromGLTF(model, accessorIndex);
+    const auto normalized = model.accessors[accessorIndex].normalized;
+    std::vector<float> result;
+    result.reserve(accessor.count * accessor.componentCount);
+    for (size_t i = 0; i < accessor.count; i++) {
+        // Wider elements like matrices are read four components at a time
+        for (int offset = 0; offset < accessor.componentCount; offset += 4) {
+            auto shifted = accessor;
+            shifted.data += offset * tinygltf::GetComponentSizeInBytes(accessor.componentType);
+            shifted.componentCount = std::min(accessor.componentCount - offset, 4);
+            const auto value = readVec4(shifted, i, normalized);
+            for (int c = 0; c < shifted.componentCount; c++) {
+                result.push_back(value[c]);
+            }
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
+DeformationData loadGLTFDeformation(const tinygltf::Model &model, const tinygltf::Primitive &primitive) {
+    TRACE_SCOPE("Load deformation");
+    const auto positions = getAttribute(model, primitive.attributes, "POSITION");
+    const auto normals = getAttribute(model, primitive.attributes, "NORMAL");
+    const auto tangents = getAttribute(model, primitive.attributes, "TANGENT");
+    const auto joints = getAttribute(model, primitive.attributes, "JOINTS_0");
+    const auto weights = getAttribute(model, primitive.attributes, "WEIGHTS_0");
+    const auto vertexCount = positions.count;
+
+    DeformationData deformation;
+    deformation.vertices.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        auto &vertex = deformation.vertices[i];
+        vertex.position = glm::vec3(readVec4(positions, i, false));
+        vertex.normal = i < normals.count ? glm::vec3(readVec4(normals, i, true)) : glm::vec3(0.0f);
+        vertex.tangent = i < tangents.count ? readVec4(tangents, i, true) : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        if (i < joints.count && i < weights.count) {
+            vertex.joints = glm::uvec4(readVec4(joints, i, false));
+            vertex.weights = readVec4(weights, i, true);
+            // Quantized weights rarely add up to exactly one
+            const auto sum = vertex.weights.x + vertex.weights.y + vertex.weights.z + vertex.weights.w;
+            vertex.weights = sum > 0.0f ? vertex.weights / sum : glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+        } else {
+            vertex.joints = glm::uvec4(0);
+            vertex.weights = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+        }
+    }
+
+    deformation.targetCount = static_cast<uint32_t>(primitive.targets.size());
+    deformation.morphDeltas.resize(deformation.targetCount * vertexCount, MorphDelta{});
+    for (uint32_t target = 0; target < deformation.targetCount; target++) {
+        const auto &attributes = primitive.targets[target];
+        const auto positionDeltas = getAttribute(model, attributes, "POSITION");
+        const auto normalDeltas = getAttribute(model, attributes, "NORMAL");
+        const auto tangentDeltas = getAttribute(model, attributes, "TANGENT");
+        auto *deltas = deformation.morphDeltas.data() + target * vertexCount;
+        for (size_t i = 0; i < vertexCount; i++) {
+            if (i < positionDeltas.count) {
+                deltas[i].position = glm::vec3(readVec4(positionDeltas, i, true));
+            }
+            if (i < normalDeltas.count) {
+                deltas[i].normal = glm::vec3(readVec4(normalDeltas, i, true));
+            }
+            if (i < tangentDeltas.count) {
+                deltas[i].tangent = glm::vec3(readVec4(tangentDeltas, i, true));
+            }
+        }
+    }
+    return deformation;
+}
+
+bool isDeformable(const tinygltf::Model &model, const tinygltf::Node &node) {
+    if (node.mesh < 0) {
+        return false;
+    }
+    if (node.skin >= 0) {
+        return true;
+    }
+    return std::ranges::any_of(model.meshes[node.mesh].primitives,
+                               [](const tinygltf::Primitive &primitive) { return !primitive.targets.empty(); });
+}
+
+GLTFAnimation GLTFAnimation::fromGLTF(const tinygltf::Model &model) {
+    GLTFAnimation animation;
+    animation.nodes.resize(model.nodes.size());
+    for (size_t i = 0; i < model.nodes.size(); i++) {
+        const auto &source = model.nodes[i];
+        auto &node = animation.nodes[i];
+        node.hasMatrix = !source.matrix.empty();
+        if (node.hasMatrix) {
+            for (int j = 0; j < 16; j++) {
+                node.matrix[j / 4][j % 4] = static_cast<float>(source.matrix[j]);
+            }
+        }
+        if (!source.translation.empty()) {
+            node.translation = glm::vec3(source.translation[0], source.translation[1], source.translation[2]);
+        }
+        if (!source.rotation.empty()) {
+            // glTF stores quaternions as xyzw, the glm constructor takes w first
+            node.rotation = glm::quat(static_cast<float>(source.rotation[3]),
+                                      static_cast<float>(source.rotation[0]),
+                                      static_cast<float>(source.rotation[1]),
+                                      static_cast<float>(source.rotation[2]));
+        }
+        if (!source.scale.empty()) {
+            node.scale = glm::vec3(source.scale[0], source.scale[1], source.scale[2]);
+        }
+        if (source.mesh >= 0) {
+            const auto &mesh = model.meshes[source.mesh];
+            const auto &defaultWeights = source.weights.empty() ? mesh.weights : source.weights;
+            node.weights.assign(defaultWeights.begin(), defaultWeights.end());
+            // Weights left out default to zero
+            const auto targetCount = mesh.primitives.empty() ? 0 : mesh.primitives[0].targets.size();
+            node.weights.resize(std::max(node.weights.size(), targetCount), 0.0f);
+        }
+        animation.deformed |= isDeformable(model, source);
+        for (const auto child : source.children) {
+            animation.nodes.at(child).parent = static_cast<int32_t>(i);
+        }
+    }
+
+    const std::function<void(uint32_t)> addSubtree = [&](uint32_t nodeId) {
+        animation.nodeOrder.push_back(nodeId);
+        for (const auto child : model.nodes[nodeId].children) {
+            addSubtree(child);
+        }
+    };
+    for (uint32_t i = 0; i < animation.nodes.size(); i++) {
+        if (animation.nodes[i].parent < 0) {
+            addSubtree(i);
+        }
+    }
+
+    for (const auto &source : model.skins) {
+        Skin skin;
+        skin.joints.assign(source.joints.begin(), source.joints.end());
+        skin.inverseBindMatrices.resize(skin.joints.size(), glm::mat4(1.0f));
+        if (source.inverseBindMatrices >= 0) {
+            const auto values = readFloats(model, source.inverseBindMatrices);
+            for (size_t i = 0; i < skin.inverseBindMatrices.size() && (i + 1) * 16 <= values.size(); i++) {
+                for (int j = 0; j < 16; j++) {
+                    skin.inverseBindMatrices[i][j / 4][j % 4] = values[i * 16 + j];
+                }
+            }
+        }
+        animation.skins.push_back(std::move(skin));
+    }
+
+    // Only the first animation is played, files with several of them are usually clip libraries
+    if (!model.animations.empty()) {
+        const auto &source = model.animations[0];
+        for (const auto &sourceChannel : source.channels) {
+            if (sourceChannel.target_node < 0) {
+                continue;
+            }
+            const auto &sampler = source.samplers.at(sourceChannel.sampler);
+            Channel channel{
+                .node = static_cast<uint32_t>(sourceChannel.target_node),
+                .interpolation = sampler.interpolation == "STEP"          ? Interpolation::Step
+                                 : sampler.interpolation == "CUBICSPLINE" ? Interpolation::CubicSpline
+                                                                          : Interpolation::Linear,
+                .times = readFloats(model, sampler.input),
+                .values = readFloats(model, sampler.output),
+            };
+            if (sourceChannel.target_path == "translation") {
+                channel.path = Path::Translation;
+            } else if (sourceChannel.target_path == "rotation") {
+                channel.path = Path::Rotation;
+            } else if (sourceChannel.target_path == "scale") {
+                channel.path = Path::Scale;
+            } else if (sourceChannel.target_path == "weights") {
+                channel.path = Path::Weights;
+            } else {
+                continue;
+            }
+            if (channel.times.empty()) {
+                continue;
+            }
+            const auto valuesPerKeyframe = channel.interpolation == Interpolation::CubicSpline ? 3u : 1u;
+            channel.components = static_cast<uint32_t>(channel.values.size() / (channel.times.size() * valuesPerKeyframe));
+            if (channel.components == 0) {
+                continue;
+            }
+            if (channel.path != Path::Weights) {
+                animation.nodes[channel.node].animated = true;
+            }
+            animation.duration = std::max(animation.duration, channel.times.back());
+            animation.channels.push_back(std::move(channel));
+        }
+    }
+
+    for (const auto nodeId : animation.nodeOrder) {
+        auto &node = animation.nodes[nodeId];
+        if (node.parent >= 0) {
+            node.animated |= animation.nodes[node.parent].animated;
+        }
+    }
+    animation.globalTransforms.resize(animation.nodes.size(), glm::mat4(1.0f));
+    animation.updateGlobalTransforms();
+    return animation;
+}
+
+bool GLTFAnimation::empty() const {
+    return channels.empty() && !deformed;
+}
+
+bool GLTFAnimation::evaluate(float time) {
+    // Without channels the pose never changes, the first evaluation is only needed for the skins and morph targets
+    if (channels.empty()) {
+        const auto first = !evaluated;
+        evaluated = true;
+        return first;
+    }
+    const auto localTime = duration > 0.0f ? std::fmod(time, duration) : 0.0f;
+    std::vector<float> value;
+    for (const auto &channel : channels) {
+        value.resize(channel.components);
+        sampleChannel(channel, localTime, value.data());
+        auto &node = nodes[channel.node];
+        switch (channel.path) {
+            case Path::Translation:
+                node.translation = glm::vec3(value[0], value[1], value[2]);
+                break;
+            case Path::Rotation:
+                node.rotation = glm::normalize(glm::quat(value[3], value[0], value[1], value[2]));
+                break;
+            case Path::Scale:
+                node.scale = glm::vec3(value[0], value[1], value[2]);
+                break;
+            case Path::Weights:
+                node.weights.assign(value.begin(), value.end());
+                break;
+        }
+    }
+    updateGlobalTransforms();
+    evaluated = true;
+    return true;
+}
+
+void GLTFAnimation::sampleChannel(const Channel &channel, float time, float *result) const {
+    const auto components = channel.components;
+    const auto stride = channel.interpolation == Interpolation::CubicSpline ? 3 * components : components;
+    // Cubic spline keyframes start with the in-tangent, the value itself is the second element
+    const auto valueOffset = channel.interpolation == Interpolation::CubicSpline ? components : 0;
+    const auto getValue = [&](size_t keyframe, uint32_t offset) {
+        return channel.values.data() + keyframe * stride + offset;
+    };
+
+    const auto next = std::upper_bound(channel.times.begin(), channel.times.end(), time) - channel.times.begin();
+    if (next == 0 || static_cast<size_t>(next) == channel.times.size()) {
+        const auto *value = getValue(next == 0 ? 0 : channel.times.size() - 1, valueOffset);
+        std::copy(value, value + components, result);
+        return;
+    }
+    const auto previous = next - 1;
+    const auto delta = channel.times[next] - channel.times[previous];
+    const auto t = delta > 0.0f ? (time - channel.times[previous]) / delta : 0.0f;
+
+    switch (channel.interpolation) {
+        case Interpolation::Step: {
+            const auto *value = getValue(previous, 0);
+            std::copy(value, value + components, result);
+            return;
+        }
+        case Interpolation::Linear: {
+            const auto *a = getValue(previous, 0);
+            const auto *b = getValue(next, 0);
+            if (channel.path == Path::Rotation) {
+                const auto rotation = glm::slerp(
+                    glm::quat(a[3], a[0], a[1], a[2]), glm::quat(b[3], b[0], b[1], b[2]), t);
+                result[0] = rotation.x;
+                result[1] = rotation.y;
+                result[2] = rotation.z;
+                result[3] = rotation.w;
+                return;
+            }
+            for (uint32_t i = 0; i < components; i++) {
+                result[i] = a[i] + (b[i] - a[i]) * t;
+            }
+            return;
+        }
+        case Interpolation::CubicSpline: {
+            // Hermite spline, the tangents are scaled by the keyframe interval as the glTF specification describes
+            const auto t2 = t * t;
+            const auto t3 = t2 * t;
+            const auto *v0 = getValue(previous, components);
+            const auto *b0 = getValue(previous, 2 * components);
+            const auto *a1 = getValue(next, 0);
+            const auto *v1 = getValue(next, components);
+            for (uint32_t i = 0; i < components; i++) {
+                result[i] = (2.0f * t3 - 3.0f * t2 + 1.0f) * v0[i] + (t3 - 2.0f * t2 + t) * delta * b0[i] +
+                            (-2.0f * t3 + 3.0f * t2) * v1[i] + (t3 - t2) * delta * a1[i];
+            }
+            return;
+        }
+    }
+}
+
+void GLTFAnimation::updateGlobalTransforms() {
+    for (const auto nodeId : nodeOrder) {
+        const auto &node = nodes[nodeId];
+        auto local = node.matrix;
+        if (!node.hasMatrix) {
+            local = glm::translate(glm::mat4(1.0f), node.translation) * glm::mat4_cast(node.rotation) *
+                    glm::scale(glm::mat4(1.0f), node.scale);
+        }
+        globalTransforms[nodeId] = node.parent >= 0 ? globalTransforms[node.parent] * local : local;
+    }
+}
+
+const glm::mat4 &GLTFAnimation::getGlobalTransform(uint32_t node) const {
+    return globalTransforms.at(node);
+}
+
+bool GLTFAnimation::isNodeAnimated(uint32_t node) const {
+    return nodes.at(node).animated;
+}
+
+std::vector<glm::mat4> GLTFAnimation::getJointMatrices(uint32_t skin, uint32_t meshNode) const {
+    const auto &joints = skins.at(skin);
+    const auto toMeshNode = glm::inverse(globalTransforms.at(meshNode));
+    std::vector<glm::mat4> matrices(joints.joints.size());
+    for (size_t i = 0; i < matrices.size(); i++) {
+        matrices[i] = toMeshNode * globalTransforms.at(joints.joints[i]) * joints.inverseBindMatrices[i];
+    }
+    return matrices;
+}
+
+size_t GLTFAnimation::getJointCount(uint32_t skin) const {
+    return skins.at(skin).joints.size();
+}
+
+std::span<const float> GLTFAnimation::getWeights(uint32_t node) const {
+    return nodes.at(node).weights;
+}
+
+}  // namespace rendering
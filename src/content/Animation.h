@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/ext/quaternion_float.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <span>
+#include <vector>
+
+#include "tiny_gltf.h"
+
+namespace rendering {
+
+    // Same layout as RestVertex in shaders/compute/skinning.comp
+    struct DeformableVertex {
+        glm::vec3 position;
+        glm::vec3 normal;
+        // The bitangent sign is in w like in glTF
+        glm::vec4 tangent;
+        glm::uvec4 joints;
+        glm::vec4 weights;
+    };
+
+    // Same layout as MorphDelta in shaders/compute/skinning.comp
+    struct MorphDelta {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 tangent;
+    };
+
+    /*
+     * Undeformed attributes of a skinned or morphed primitive, in the order of its vertices in the geometry arena. The
+     * skinning pass reads these every frame and writes the deformed result over the model's range of the arena.
+     */
+    struct DeformationData {
+        std::vector<DeformableVertex> vertices;
+        // Every vertex of the first target, then every vertex of the second one and so on
+        std::vector<MorphDelta> morphDeltas;
+        uint32_t targetCount = 0;
+    };
+
+    // Reads the primitive's attributes, joints, weights and morph targets. Doesn't touch the GPU.
+    DeformationData loadGLTFDeformation(const tinygltf::Model &model, const tinygltf::Primitive &primitive);
+
+    // Whether any primitive of the mesh is deformed on the GPU, either by morph targets or by a skin on the node
+    bool isDeformable(const tinygltf::Model &model, const tinygltf::Node &node);
+
+    /*
+     * Node hierarchy, skins and the first animation of a glTF file. Everything is copied out of the file's buffers
+     * while the import is planned, so the animation outlives them.
+     */
+    class GLTFAnimation {
+    public:
+        static GLTFAnimation fromGLTF(const tinygltf::Model &model);
+
+        // Whether there is anything to evaluate at all, files without animations, skins and morph targets are static
+        [[nodiscard]] bool empty() const;
+
+        /*
+         * Samples every channel at the time, looping over the length of the animation, and updates the global node
+         * transforms. Returns whether anything may have changed since the last call.
+         */
+        bool evaluate(float time);
+
+        // Transform from the node to the root of the file
+        [[nodiscard]] const glm::mat4 &getGlobalTransform(uint32_t node) const;
+
+        // Whether the node's global transform is driven by a channel, either on itself or on one of its ancestors
+        [[nodiscard]] bool isNodeAnimated(uint32_t node) const;
+
+        /*
+         * Joint matrices of a skin applied to a mesh on the node. They map the mesh's bind pose into the node's space,
+         * so the instance transform still places the result like it does for rigid meshes.
+         */
+        [[nodiscard]] std::vector<glm::mat4> getJointMatrices(uint32_t skin, uint32_t meshNode) const;
+
+        [[nodiscard]] size_t getJointCount(uint32_t skin) const;
+
+        // Current morph target weights of the mesh on the node
+        [[nodiscard]] std::span<const float> getWeights(uint32_t node) const;
+
+    private:
+        enum class Path : uint32_t {
+            Translation,
+            Rotation,
+            Scale,
+            Weights,
+        };
+
+        enum class Interpolation : uint32_t {
+            Linear,
+            Step,
+            CubicSpline,
+        };
+
+        struct Channel {
+            uint32_t node;
+            Path path;
+            Interpolation interpolation;
+            std::vector<float> times;
+            // Tightly packed keyframe values, cubic spline keyframes hold an in-tangent, the value and an out-tangent
+            std::vector<float> values;
+            // Floats per value, the target count for weights
+            uint32_t components;
+        };
+
+        struct Node {
+            int32_t parent = -1;
+            // Nodes given as a matrix can't be animated, the others are composed from their TRS properties
+            bool hasMatrix = false;
+            glm::mat4 matrix = glm::mat4(1.0f);
+            glm::vec3 translation = glm::vec3(0.0f);
+            glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+            glm::vec3 scale = glm::vec3(1.0f);
+            std::vector<float> weights;
+            bool animated = false;
+        };
+
+        struct Skin {
+            std::vector<uint32_t> joints;
+            std::vector<glm::mat4> inverseBindMatrices;
+        };
+
+        std::vector<Node> nodes;
+        // Parents come before their children, so global transforms can be computed in a single pass
+        std::vector<uint32_t> nodeOrder;
+        std::vector<glm::mat4> globalTransforms;
+        std::vector<Channel> channels;
+        std::vector<Skin> skins;
+        float duration = 0.0f;
+        bool deformed = false;
+        bool evaluated = false;
+
+        void sampleChannel(const Channel &channel, float time, float *result) const;
+
+        void updateGlobalTransforms();
+    };
+
+}  // namespace rendering
@@ -1,21 +1,52 @@
 #include "Buffer.h"
 
+#include "UploadManager.h"
+
 namespace rendering {
 
-Buffer::Buffer(const VulkanContext &context, uint32_t size, vk::BufferUsageFlags usage, const void *data) {
+namespace {
+
+vma::AllocationCreateInfo getAllocationCreateInfo(MemoryClass memoryClass) {
+    switch (memoryClass) {
+        case MemoryClass::Static:
+            return {{}, vma::MemoryUsage::eAutoPreferDevice};
+        case MemoryClass::Dynamic:
+            return {
+                vma::AllocationCreateFlagBits::eMapped | vma::AllocationCreateFlagBits::eHostAccessSequentialWrite,
+                vma::MemoryUsage::eAuto,
+            };
+        case MemoryClass::Readback:
+            return {
+                vma::AllocationCreateFlagBits::eMapped | vma::AllocationCreateFlagBits::eHostAccessRandom,
+                vma::MemoryUsage::eAuto,
+            };
+    }
+    throw std::runtime_error("Unhandled memory class");
+}
+
+}  // namespace
+
+Buffer::Buffer(const VulkanContext &context,
+               vk::DeviceSize size,
+               vk::BufferUsageFlags usage,
+               const void *data,
+               MemoryClass memoryClass)
+    : memoryClass(memoryClass) {
+    if (memoryClass == MemoryClass::Static) {
+        usage |= vk::BufferUsageFlagBits::eTransferDst;
+    }
     const vk::BufferCreateInfo bufferCreateInfo{
         {},
         size,
         usage,
         vk::SharingMode::eExclusive,
     };
-    constexpr vma::AllocationCreateInfo allocationCreateInfo{
-        {},
-        vma::MemoryUsage::eCpuToGpu,
-    };
-    auto [buf, alloc] = context.allocator->createBufferUnique(bufferCreateInfo, allocationCreateInfo);
+    vma::AllocationInfo allocationInfo;
+    auto [buf, alloc] = context.allocator->createBufferUnique(
+        bufferCreateInfo, getAllocationCreateInfo(memoryClass), &allocationInfo);
     buffer = std::move(buf);
     allocation = std::move(alloc);
+    mapped = allocationInfo.pMappedData;
 
     if (usage & vk::BufferUsageFlagBits::eShaderDeviceAddress) {
         const vk::BufferDeviceAddressInfo addressInfo{*buffer};
@@ -27,14 +58,29 @@ Buffer::Buffer(const VulkanContext &context, uint32_t size, vk::BufferUsageFlags
     }
 }
 
-void Buffer::updateData(const VulkanContext &context, uint32_t size, const void *data) {
-    void *mapped = context.allocator->mapMemory(*allocation);
-    memcpy(mapped, data, size);
-    context.allocator->unmapMemory(*allocation);
+void Buffer::updateData(const VulkanContext &context, vk::DeviceSize size, const void *data, vk::DeviceSize offset) {
+    if (memoryClass == MemoryClass::Static) {
+        context.uploads->uploadBuffer(*buffer, offset, data, size);
+        return;
+    }
+    memcpy(static_cast<uint8_t *>(mapped) + offset, data, size);
+    context.allocator->flushAllocation(*allocation, offset, size);
+}
+
+void Buffer::readData(const VulkanContext &context, vk::DeviceSize size, void *data, vk::DeviceSize offset) const {
+    if (memoryClass != MemoryClass::Readback) {
+        throw std::runtime_error("Tried to read back a buffer that isn't in the readback memory class");
+    }
+    context.allocator->invalidateAllocation(*allocation, offset, size);
+    memcpy(data, static_cast<const uint8_t *>(mapped) + offset, size);
 }
 
 Buffer::Buffer(Buffer &&other) noexcept
-    : buffer(std::move(other.buffer)), allocation(std::move(other.allocation)), _deviceAddress(other._deviceAddress) {}
+    : buffer(std::move(other.buffer)),
+      allocation(std::move(other.allocation)),
+      _deviceAddress(other._deviceAddress),
+      memoryClass(other.memoryClass),
+      mapped(other.mapped) {}
 
 vk::DeviceAddress Buffer::deviceAddress() {
     if (!_deviceAddress.has_value()) {
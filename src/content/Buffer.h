@@ -8,12 +8,26 @@
 
 namespace rendering {
 
+    // Decides which memory type a buffer is allocated from and how its contents are written
+    enum class MemoryClass {
+        // Written once and then only read by the GPU. Device local, data is staged through the upload manager.
+        Static,
+        // Rewritten by the CPU every frame. Persistently mapped, VMA prefers BAR memory if it's available.
+        Dynamic,
+        // Written by the GPU and read by the CPU. Persistently mapped host cached memory.
+        Readback,
+    };
+
     class Buffer {
     public:
         vma::UniqueBuffer buffer;
         vma::UniqueAllocation allocation;
 
-        Buffer(const VulkanContext &context, uint32_t size, vk::BufferUsageFlags usage, const void *data = nullptr);
+        Buffer(const VulkanContext &context,
+               vk::DeviceSize size,
+               vk::BufferUsageFlags usage,
+               const void *data = nullptr,
+               MemoryClass memoryClass = MemoryClass::Static);
 
         Buffer(const Buffer &) = delete;
 
@@ -21,11 +35,17 @@ namespace rendering {
 
         Buffer(Buffer &&other) noexcept;
 
-        void updateData(const VulkanContext &context, uint32_t size, const void *data);
+        // Static buffers are updated through a staging copy, the others are written through their mapping directly
+        void updateData(const VulkanContext &context, vk::DeviceSize size, const void *data, vk::DeviceSize offset = 0);
+
+        // Only valid for Readback buffers, the GPU writes have to be finished and made host visible by the caller
+        void readData(const VulkanContext &context, vk::DeviceSize size, void *data, vk::DeviceSize offset = 0) const;
 
         vk::DeviceAddress deviceAddress();
     private:
         std::optional<vk::DeviceAddress> _deviceAddress;
+        MemoryClass memoryClass;
+        void *mapped = nullptr;
 
     };
 
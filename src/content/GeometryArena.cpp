@@ -0,0 +1,85 @@
+#include "GeometryArena.h"
+
+#include <algorithm>
+
+namespace rendering {
+
+GeometryAllocation GeometryArena::allocate(VulkanContext &context, const MeshData &meshData) {
+    const auto vertexCount = static_cast<uint32_t>(meshData.positions.size());
+    const auto indexCount = static_cast<uint32_t>(meshData.indexCount());
+    const auto indexBytes =
+        meshData.hasShortIndices() ? meshData.shortIndices.size_bytes() : meshData.indices.size_bytes();
+    const auto indexWords = static_cast<uint32_t>((indexBytes + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+
+    const auto fits = [&](const Chunk &chunk) {
+        return chunk.vertexCount + vertexCount <= chunk.vertexCapacity &&
+               chunk.indexWordCount + indexWords <= chunk.indexWordCapacity;
+    };
+    auto chunkId = static_cast<uint32_t>(std::ranges::find_if(chunks, fits) - chunks.begin());
+    if (chunkId == chunks.size()) {
+        addChunk(context,
+                 std::max(vertexCount, GEOMETRY_CHUNK_VERTICES),
+                 std::max(indexWords, GEOMETRY_CHUNK_INDEX_WORDS));
+    }
+
+    auto &chunk = chunks[chunkId];
+    const GeometryAllocation allocation{
+        .chunk = chunkId,
+        .firstIndexWord = chunk.indexWordCount,
+        .firstVertex = chunk.vertexCount,
+        .indexCount = indexCount,
+        .vertexCount = vertexCount,
+        .shortIndices = meshData.hasShortIndices(),
+    };
+    chunk.indexWordCount += indexWords;
+    chunk.vertexCount += vertexCount;
+
+    const void *indexData = meshData.hasShortIndices() ? static_cast<const void *>(meshData.shortIndices.data())
+                                                       : static_cast<const void *>(meshData.indices.data());
+    chunk.positionBuffer->updateData(context,
+                                     meshData.positions.size_bytes(),
+                                     meshData.positions.data(),
+                                     allocation.firstVertex * sizeof(glm::vec3));
+    chunk.indexBuffer->updateData(context, indexBytes, indexData, allocation.firstIndexWord * sizeof(uint32_t));
+    chunk.vertexDataBuffer->updateData(context,
+                                       meshData.vertexData.size_bytes(),
+                                       meshData.vertexData.data(),
+                                       allocation.firstVertex * sizeof(VertexData));
+    return allocation;
+}
+
+std::vector<GeometryChunkDesc> GeometryArena::getChunkDescs() const {
+    std::vector<GeometryChunkDesc> descs;
+    descs.reserve(chunks.size());
+    for (const auto &chunk : chunks) {
+        descs.push_back(GeometryChunkDesc{
+            .indexAddress = chunk.indexBuffer->deviceAddress(),
+            .positionAddress = chunk.positionBuffer->deviceAddress(),
+            .vertexDataAddress = chunk.vertexDataBuffer->deviceAddress(),
+        });
+    }
+    return descs;
+}
+
+void GeometryArena::addChunk(VulkanContext &context, uint32_t vertexCapacity, uint32_t indexWordCapacity) {
+    constexpr auto geometryUsage =
+        vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer;
+    constexpr auto buildInputUsage = geometryUsage | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+
+    Chunk chunk{
+        .positionBuffer = std::make_unique<Buffer>(context,
+                                                   vertexCapacity * sizeof(glm::vec3),
+                                                   buildInputUsage),
+        .indexBuffer = std::make_unique<Buffer>(context,
+                                                indexWordCapacity * sizeof(uint32_t),
+                                                buildInputUsage),
+        .vertexDataBuffer = std::make_unique<Buffer>(context,
+                                                     vertexCapacity * sizeof(VertexData),
+                                                     geometryUsage),
+        .vertexCapacity = vertexCapacity,
+        .indexWordCapacity = indexWordCapacity,
+    };
+    chunks.push_back(std::move(chunk));
+}
+
+}  // namespace rendering
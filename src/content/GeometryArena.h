@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "Buffer.h"
+#include "MeshData.h"
+
+namespace rendering {
+
+    constexpr uint32_t GEOMETRY_CHUNK_VERTICES = 1 << 21;
+    constexpr uint32_t GEOMETRY_CHUNK_INDEX_WORDS = 3 << 22;
+
+    // Same layout as GeometryChunk in shaders/rt/buffers.glsl
+    struct GeometryChunkDesc {
+        uint64_t indexAddress;
+        uint64_t positionAddress;
+        uint64_t vertexDataAddress;
+    };
+
+    /*
+     * Where a model's geometry lives inside the arena. Index buffers are addressed in 32-bit words so every model's
+     * indices start 4 byte aligned, whatever their width. Indices are relative to firstVertex.
+     */
+    struct GeometryAllocation {
+        uint32_t chunk;
+        uint32_t firstIndexWord;
+        uint32_t firstVertex;
+        uint32_t indexCount;
+        uint32_t vertexCount;
+        bool shortIndices;
+    };
+
+    /*
+     * Packs the geometry of every model into a few large device local buffers. Chunks are filled front to back and
+     * never freed individually, meshes larger than the default chunk size get a chunk of their own.
+     */
+    class GeometryArena {
+    public:
+        struct Chunk {
+            std::unique_ptr<Buffer> positionBuffer;
+            std::unique_ptr<Buffer> indexBuffer;
+            std::unique_ptr<Buffer> vertexDataBuffer;
+            uint32_t vertexCapacity;
+            uint32_t indexWordCapacity;
+            uint32_t vertexCount = 0;
+            uint32_t indexWordCount = 0;
+        };
+
+        std::vector<Chunk> chunks;
+
+        GeometryAllocation allocate(VulkanContext &context, const MeshData &meshData);
+
+        [[nodiscard]] std::vector<GeometryChunkDesc> getChunkDescs() const;
+
+    private:
+        void addChunk(VulkanContext &context, uint32_t vertexCapacity, uint32_t indexWordCapacity);
+    };
+
+}  // namespace rendering
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace rendering {
+
+    // 64-bit MurmurHash2 (MurmurHash64A). Not cryptographic, but fast and well distributed for cache keys and
+    // checksums.
+    inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0) {
+        constexpr uint64_t m = 0xc6a4a7935bd1e995ull;
+        constexpr int r = 47;
+
+        const auto *bytes = static_cast<const uint8_t *>(data);
+        uint64_t h = seed ^ (size * m);
+
+        const auto blockCount = size / 8;
+        for (size_t i = 0; i < blockCount; i++) {
+            uint64_t k;
+            std::memcpy(&k, bytes + i * 8, sizeof(uint64_t));
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+
+        const auto *tail = bytes + blockCount * 8;
+        const auto remaining = size & 7;
+        if (remaining > 0) {
+            for (size_t i = remaining; i > 0; i--) {
+                h ^= static_cast<uint64_t>(tail[i - 1]) << (8 * (i - 1));
+            }
+            h *= m;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+
+    inline uint64_t hashCombine(uint64_t seed, uint64_t value) {
+        return hashBytes(&value, sizeof(value), seed);
+    }
+
+}  // namespace rendering
@@ -1,31 +1,60 @@
 #include "Image.h"
 
-#include "Buffer.h"
+#include <algorithm>
+#include <bit>
+#include <vector>
 
-rendering::Image::Image(VulkanContext &context, vk::Extent2D size, vk::Format format, const void *data)
-        : size(size) {
-    const vk::ImageCreateInfo createInfo{
-            {},
-            vk::ImageType::e2D,
-            format,
-            vk::Extent3D{size.width, size.height, 1},
-            1,
-            1,
-            vk::SampleCountFlagBits::e1,
-            vk::ImageTiling::eOptimal,
-            vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst |
-            vk::ImageUsageFlagBits::eSampled,
-            vk::SharingMode::eExclusive,
-    };
+#include "UploadManager.h"
 
-    constexpr vma::AllocationCreateInfo allocationCreateInfo{
-            vma::AllocationCreateFlagBits::eDedicatedMemory,
-            vma::MemoryUsage::eAuto,
-    };
+namespace {
 
-    auto [img, alloc] = context.allocator->createImageUnique(createInfo, allocationCreateInfo);
-    image = std::move(img);
-    allocation = std::move(alloc);
+vk::Format getVulkanFormat(rendering::TextureFormat format) {
+    switch (format) {
+        case rendering::TextureFormat::RGBA8:
+            return vk::Format::eR8G8B8A8Unorm;
+        case rendering::TextureFormat::BC7:
+            return vk::Format::eBc7UnormBlock;
+        case rendering::TextureFormat::BC5:
+            return vk::Format::eBc5UnormBlock;
+        case rendering::TextureFormat::BC4:
+            return vk::Format::eBc4UnormBlock;
+    }
+    throw std::runtime_error("Unhandled baked texture format");
+}
+
+vk::ComponentMapping getComponentMapping(rendering::TextureSwizzle swizzle) {
+    switch (swizzle) {
+        case rendering::TextureSwizzle::Identity:
+            break;
+        case rendering::TextureSwizzle::Grayscale:
+            return {vk::ComponentSwizzle::eR,
+                    vk::ComponentSwizzle::eR,
+                    vk::ComponentSwizzle::eR,
+                    vk::ComponentSwizzle::eOne};
+        case rendering::TextureSwizzle::MetallicRoughness:
+            return {vk::ComponentSwizzle::eZero,
+                    vk::ComponentSwizzle::eR,
+                    vk::ComponentSwizzle::eG,
+                    vk::ComponentSwizzle::eOne};
+    }
+    return {};
+}
+
+}  // namespace
+
+rendering::Image::Image(
+        VulkanContext &context,
+        vk::Extent2D size,
+        vk::Format format,
+        const void *data,
+        bool generateMips
+)
+        : size(size),
+          mipLevels(generateMips && data ? std::bit_width(std::max(size.width, size.height)) : 1) {
+    allocate(context,
+             format,
+             vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc |
+             vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
 
     if (data) {
         uint32_t bytesPerPixel;
@@ -35,65 +64,72 @@ rendering::Image::Image(VulkanContext &context, vk::Extent2D size, vk::Format fo
                 bytesPerPixel = 4;
                 break;
             default:
-                throw std::runtime_error(std::format("Unhandled texture format: %s", vk::to_string(format)));
+                throw std::runtime_error(std::format("Unhandled texture format: {}", vk::to_string(format)));
         }
         const auto bytes = size.width * size.height * bytesPerPixel;
-        Buffer buffer(context, bytes, vk::BufferUsageFlagBits::eTransferSrc, data);
-        context.createAndSubmitCommandBuffer(
-                [&](vk::CommandBuffer cmd) {
-                    vk::BufferImageCopy region{
-                            0,
-                            0,
-                            0,
-                            vk::ImageSubresourceLayers{
-                                    vk::ImageAspectFlagBits::eColor,
-                                    0,
-                                    0,
-                                    1,
-                            },
-                            {},
-                            vk::Extent3D{
-                                    size.width,
-                                    size.height,
-                                    1,
-                            },
-                    };
-                    rendering::VulkanContext::transitionImage(
-                            cmd, *image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal
-                    );
-                    cmd.copyBufferToImage(*buffer.buffer, *image, vk::ImageLayout::eTransferDstOptimal, {region});
-
-                    rendering::VulkanContext::transitionImage(
-                            cmd, *image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral
-                    );
-                },
-                false
-        );
+        context.uploads->uploadImage(*image, size, data, bytes, mipLevels);
     } else {
-        context.createAndSubmitCommandBuffer(
+        context.uploads->record(
                 [&](vk::CommandBuffer cmd) {
                     rendering::VulkanContext::transitionImage(
                             cmd, *image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral
                     );
-                },
-                false
+                }
         );
     }
 
+    createView(context, format, {});
+}
+
+rendering::Image::Image(VulkanContext &context, const BakedTexture &texture, uint32_t firstLevel)
+        : size(std::max(texture.width >> firstLevel, 1u), std::max(texture.height >> firstLevel, 1u)),
+          mipLevels(texture.mipLevels() - firstLevel) {
+    // Block compressed formats can't be used as storage images
+    const auto format = getVulkanFormat(texture.format);
+    allocate(context, format, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
+    const auto firstOffset = texture.levelOffsets[firstLevel];
+    std::vector<vk::DeviceSize> levelOffsets;
+    for (auto level = firstLevel; level < texture.mipLevels(); level++) {
+        levelOffsets.push_back(texture.levelOffsets[level] - firstOffset);
+    }
+    context.uploads->uploadImageLevels(*image, size, texture.data.subspan(firstOffset), levelOffsets);
+    createView(context, format, getComponentMapping(texture.swizzle));
+}
+
+void rendering::Image::allocate(VulkanContext &context, vk::Format format, vk::ImageUsageFlags usage) {
+    const vk::ImageCreateInfo createInfo{
+            {},
+            vk::ImageType::e2D,
+            format,
+            vk::Extent3D{size.width, size.height, 1},
+            mipLevels,
+            1,
+            vk::SampleCountFlagBits::e1,
+            vk::ImageTiling::eOptimal,
+            usage,
+            vk::SharingMode::eExclusive,
+    };
+
+    constexpr vma::AllocationCreateInfo allocationCreateInfo{
+            vma::AllocationCreateFlagBits::eDedicatedMemory,
+            vma::MemoryUsage::eAutoPreferDevice,
+    };
+
+    auto [img, alloc] = context.allocator->createImageUnique(createInfo, allocationCreateInfo);
+    image = std::move(img);
+    allocation = std::move(alloc);
+}
+
+void rendering::Image::createView(VulkanContext &context, vk::Format format, vk::ComponentMapping components) {
     const vk::ImageViewCreateInfo viewCreateInfo{
             {},
             *image,
             vk::ImageViewType::e2D,
             format,
-            vk::ComponentMapping{
-                    vk::ComponentSwizzle::eIdentity,
-                    vk::ComponentSwizzle::eIdentity,
-                    vk::ComponentSwizzle::eIdentity,
-                    vk::ComponentSwizzle::eIdentity,
-            },
+            components,
             vk::ImageSubresourceRange{
                     vk::ImageAspectFlagBits::eColor,
-                    0, 1,
+                    0, mipLevels,
                     0, 1,
             },
     };
@@ -104,7 +140,8 @@ rendering::Image::Image(rendering::Image &&other) noexcept
         : image(std::move(other.image)),
           allocation(std::move(other.allocation)),
           view(std::move(other.view)),
-          size(other.size) {
+          size(other.size),
+          mipLevels(other.mipLevels) {
 }
 
 rendering::Image &rendering::Image::operator=(rendering::Image &&other) noexcept {
@@ -112,5 +149,6 @@ rendering::Image &rendering::Image::operator=(rendering::Image &&other) noexcept
     allocation = std::move(other.allocation);
     view = std::move(other.view);
     size = other.size;
+    mipLevels = other.mipLevels;
     return *this;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "TextureBaker.h"
 #include "VulkanContext.h"
 #include <vk_mem_alloc.hpp>
 
@@ -11,14 +12,31 @@ namespace rendering {
         vma::UniqueAllocation allocation;
         vk::UniqueImageView view;
         vk::Extent2D size;
+        uint32_t mipLevels;
 
-        Image(VulkanContext &context, vk::Extent2D size, vk::Format format, const void *data = nullptr);
+        // With generateMips set the full mip chain is allocated and filled from the initial data by blitting
+        Image(VulkanContext &context,
+              vk::Extent2D size,
+              vk::Format format,
+              const void *data = nullptr,
+              bool generateMips = false);
+
+        /*
+         * Sampled-only image holding a baked texture's mip chain from firstLevel on, the view applies the texture's
+         * swizzle. Mip 0 of the image is firstLevel of the texture.
+         */
+        Image(VulkanContext &context, const BakedTexture &texture, uint32_t firstLevel = 0);
 
         Image(const Image &) = delete;
 
         Image &operator=(const Image &) = delete;
         Image(Image&& other) noexcept;
         Image& operator=(Image&& other) noexcept;
+
+    private:
+        void allocate(VulkanContext &context, vk::Format format, vk::ImageUsageFlags usage);
+
+        void createView(VulkanContext &context, vk::Format format, vk::ComponentMapping components);
     };
 
 }
\ No newline at end of file
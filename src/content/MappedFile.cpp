@@ -0,0 +1,95 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rendering {
+
+#ifdef _WIN32
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::filesystem::path &path) {
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    file->fileHandle = CreateFileW(path.c_str(),
+                                   GENERIC_READ,
+                                   FILE_SHARE_READ,
+                                   nullptr,
+                                   OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                   nullptr);
+    if (file->fileHandle == INVALID_HANDLE_VALUE) {
+        file->fileHandle = nullptr;
+        return nullptr;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file->fileHandle, &size) || size.QuadPart == 0) {
+        return nullptr;
+    }
+    file->mappingHandle = CreateFileMappingW(file->fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (file->mappingHandle == nullptr) {
+        return nullptr;
+    }
+    file->mapped = static_cast<const uint8_t *>(MapViewOfFile(file->mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (file->mapped == nullptr) {
+        return nullptr;
+    }
+    file->mappedSize = static_cast<size_t>(size.QuadPart);
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    if (mapped != nullptr) {
+        UnmapViewOfFile(mapped);
+    }
+    if (mappingHandle != nullptr) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle != nullptr) {
+        CloseHandle(fileHandle);
+    }
+}
+
+#else
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::filesystem::path &path) {
+    const auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat fileStat {};
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    const auto size = static_cast<size_t>(fileStat.st_size);
+    auto *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    madvise(mapping, size, MADV_WILLNEED);
+
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    file->mapped = static_cast<const uint8_t *>(mapping);
+    file->mappedSize = size;
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    if (mapped != nullptr) {
+        munmap(const_cast<uint8_t *>(mapped), mappedSize);
+    }
+}
+
+#endif
+
+}  // namespace rendering
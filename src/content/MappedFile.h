@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+namespace rendering {
+
+    // Read-only memory mapping of a whole file
+    class MappedFile {
+    public:
+        // Returns nullptr if the file doesn't exist or can't be mapped
+        static std::unique_ptr<MappedFile> open(const std::filesystem::path &path);
+
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        [[nodiscard]] const uint8_t *data() const {
+            return mapped;
+        }
+
+        [[nodiscard]] size_t size() const {
+            return mappedSize;
+        }
+
+    private:
+        const uint8_t *mapped = nullptr;
+        size_t mappedSize = 0;
+#ifdef _WIN32
+        void *fileHandle = nullptr;
+        void *mappingHandle = nullptr;
+#endif
+
+        MappedFile() = default;
+    };
+
+}  // namespace rendering
@@ -0,0 +1,45 @@
+#include "Material.h"
+
+namespace rendering {
+
+bool MaterialDesc::isEmissive() const {
+    return emissiveFactor != glm::vec3(0.0f);
+}
+
+MaterialDesc MaterialDesc::fromGLTF(VulkanContext &context,
+                                    const tinygltf::Model &model,
+                                    const tinygltf::Material &material,
+                                    TextureCache &textureCache) {
+    const auto &pbr = material.pbrMetallicRoughness;
+    MaterialDesc desc{
+        .metallicFactor = static_cast<float>(pbr.metallicFactor),
+        .roughnessFactor = static_cast<float>(pbr.roughnessFactor),
+    };
+    if (pbr.baseColorFactor.size() == 4) {
+        desc.baseColorFactor = glm::vec4(pbr.baseColorFactor[0],
+                                         pbr.baseColorFactor[1],
+                                         pbr.baseColorFactor[2],
+                                         pbr.baseColorFactor[3]);
+    }
+    if (material.emissiveFactor.size() == 3) {
+        desc.emissiveFactor =
+            glm::vec3(material.emissiveFactor[0], material.emissiveFactor[1], material.emissiveFactor[2]);
+    }
+
+    if (pbr.baseColorTexture.index >= 0) {
+        desc.baseColorId = textureCache.loadImage(context, model, pbr.baseColorTexture.index, TextureKind::Color);
+    }
+    if (material.normalTexture.index >= 0) {
+        desc.normalId = textureCache.loadImage(context, model, material.normalTexture.index, TextureKind::Normal);
+    }
+    if (pbr.metallicRoughnessTexture.index >= 0) {
+        desc.metallicRoughnessId = textureCache.loadImage(
+            context, model, pbr.metallicRoughnessTexture.index, TextureKind::MetallicRoughness);
+    }
+    if (material.emissiveTexture.index >= 0) {
+        desc.emissiveId = textureCache.loadImage(context, model, material.emissiveTexture.index, TextureKind::Emissive);
+    }
+    return desc;
+}
+
+}  // namespace rendering
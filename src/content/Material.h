@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <cstdint>
+
+#include "TextureCache.h"
+#include "VulkanContext.h"
+#include "tiny_gltf.h"
+
+namespace rendering {
+
+    // Layout of MaterialData in shaders/lib/material.glsl. Textures are multiplied by the factors, -1 means no texture.
+    struct MaterialDesc {
+        glm::vec4 baseColorFactor = glm::vec4(1.0f);
+        glm::vec3 emissiveFactor = glm::vec3(0.0f);
+        // Primitives without a material have always been shaded as rough dielectrics
+        float metallicFactor = 0.0f;
+        float roughnessFactor = 1.0f;
+        int32_t baseColorId = -1;
+        int32_t normalId = -1;
+        int32_t metallicRoughnessId = -1;
+        int32_t emissiveId = -1;
+
+        [[nodiscard]] bool isEmissive() const;
+
+        // Loads the textures of the material through the cache
+        static MaterialDesc fromGLTF(VulkanContext &context,
+                                     const tinygltf::Model &model,
+                                     const tinygltf::Material &material,
+                                     TextureCache &textureCache);
+    };
+
+}  // namespace rendering
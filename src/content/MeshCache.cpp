@@ -0,0 +1,161 @@
+#include "MeshCache.h"
+
+#include <atomic>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Hash.h"
+#include "Trace.h"
+
+namespace rendering {
+
+MeshCache::MeshCache(std::filesystem::path root) : root(std::move(root)) {}
+
+std::filesystem::path MeshCache::getPath(const std::string &modelPath, uint64_t key, const std::string &extension) {
+    const auto directory = root / modelPath;
+    auto path = directory / std::format("{:016x}{}", key, extension);
+    std::lock_guard lock(mutex);
+    usedFiles[directory].insert(path.filename());
+    extensions.insert(extension);
+    return path;
+}
+
+void MeshCache::evictUnused() {
+    std::lock_guard lock(mutex);
+    for (const auto &[directory, used] : usedFiles) {
+        std::error_code error;
+        std::vector<std::filesystem::path> stale;
+        for (const auto &entry : std::filesystem::directory_iterator(directory, error)) {
+            const auto &path = entry.path();
+            // Temporary files keep the extension of the file they replace in front of .tmp, see getTemporaryPath
+            const auto extension = path.extension() == ".tmp" ? path.stem().extension() : path.extension();
+            const auto isCacheFile = extensions.contains(extension.string());
+            if (entry.is_regular_file() && !used.contains(path.filename()) && isCacheFile) {
+                stale.push_back(path);
+            }
+        }
+        for (const auto &path : stale) {
+            std::filesystem::remove(path, error);
+        }
+        if (!stale.empty()) {
+            std::cout << "Evicted " << stale.size() << " stale cache entries from " << directory << "\n";
+        }
+    }
+    usedFiles.clear();
+}
+
+std::filesystem::path getTemporaryPath(const std::filesystem::path &path) {
+    // The process tag separates concurrent runs sharing the cache, the counter the writers within one run
+    static const uint64_t processTag = (static_cast<uint64_t>(std::random_device{}()) << 32) | std::random_device{}();
+    static std::atomic<uint64_t> counter = 0;
+    auto temporaryPath = path;
+    temporaryPath.replace_filename(std::format("{}.{:016x}-{}{}.tmp",
+                                               path.stem().string(),
+                                               processTag,
+                                               counter.fetch_add(1, std::memory_order_relaxed),
+                                               path.extension().string()));
+    return temporaryPath;
+}
+
+template <typename T>
+bool validateSection(const MeshCacheSection &section, uint64_t fileSize) {
+    if (section.elementSize != sizeof(T) || section.offset % MESH_CACHE_ALIGNMENT != 0) {
+        return false;
+    }
+    // Checked as a division so a huge count can't overflow the multiplication
+    return section.offset <= fileSize && section.count <= (fileSize - section.offset) / sizeof(T);
+}
+
+template <typename T>
+std::span<const T> getSection(const MappedFile &file, const MeshCacheSection &section) {
+    return {reinterpret_cast<const T *>(file.data() + section.offset), section.count};
+}
+
+std::optional<MeshData> readMeshCache(const std::filesystem::path &path) {
+    TRACE_SCOPE("Read mesh cache");
+    auto file = MappedFile::open(path);
+    if (!file || file->size() < sizeof(MeshCacheHeader)) {
+        return std::nullopt;
+    }
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(MeshCacheHeader));
+    if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION) {
+        return std::nullopt;
+    }
+    if (header.fileSize != file->size() || !validateSection<glm::vec3>(header.positions, header.fileSize) ||
+        !validateSection<uint32_t>(header.indices, header.fileSize) ||
+        !validateSection<uint16_t>(header.shortIndices, header.fileSize) ||
+        !validateSection<VertexData>(header.vertexData, header.fileSize)) {
+        std::cout << "Ignoring malformed mesh cache file " << path << "\n";
+        return std::nullopt;
+    }
+    const auto payloadHash =
+        hashBytes(file->data() + sizeof(MeshCacheHeader), file->size() - sizeof(MeshCacheHeader), MESH_CACHE_VERSION);
+    if (payloadHash != header.payloadHash) {
+        std::cout << "Ignoring corrupt mesh cache file " << path << "\n";
+        return std::nullopt;
+    }
+
+    const auto positions = getSection<glm::vec3>(*file, header.positions);
+    const auto indices = getSection<uint32_t>(*file, header.indices);
+    const auto shortIndices = getSection<uint16_t>(*file, header.shortIndices);
+    const auto vertexData = getSection<VertexData>(*file, header.vertexData);
+    MeshData meshData(std::move(file), positions, indices, shortIndices, vertexData);
+    meshData.vertexFlags = header.vertexFlags;
+    return meshData;
+}
+
+template <typename T>
+MeshCacheSection appendSection(std::vector<uint8_t> &payload, std::span<const T> data) {
+    // Offsets are relative to the start of the file, the header is written in front of the payload
+    const uint64_t end = sizeof(MeshCacheHeader) + payload.size();
+    const auto offset = (end + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+    const auto start = static_cast<size_t>(offset - sizeof(MeshCacheHeader));
+    payload.resize(start + data.size_bytes());
+    if (!data.empty()) {
+        std::memcpy(payload.data() + start, data.data(), data.size_bytes());
+    }
+    return {offset, data.size(), sizeof(T)};
+}
+
+void writeMeshCache(const std::filesystem::path &path, const MeshData &meshData) {
+    TRACE_SCOPE("Write mesh cache");
+    std::vector<uint8_t> payload;
+    MeshCacheHeader header{
+        .magic = MESH_CACHE_MAGIC,
+        .version = MESH_CACHE_VERSION,
+    };
+    header.positions = appendSection(payload, meshData.positions);
+    header.indices = appendSection(payload, meshData.indices);
+    header.shortIndices = appendSection(payload, meshData.shortIndices);
+    header.vertexData = appendSection(payload, meshData.vertexData);
+    header.vertexFlags = meshData.vertexFlags;
+    header.fileSize = sizeof(MeshCacheHeader) + payload.size();
+    header.payloadHash = hashBytes(payload.data(), payload.size(), MESH_CACHE_VERSION);
+
+    // Written under a temporary name and renamed, so readers never see a partially written file
+    std::filesystem::create_directories(path.parent_path());
+    const auto temporaryPath = getTemporaryPath(path);
+    {
+        std::ofstream cacheFile(temporaryPath, std::ios::binary | std::ios::trunc);
+        cacheFile.write(reinterpret_cast<const char *>(&header), sizeof(MeshCacheHeader));
+        cacheFile.write(reinterpret_cast<const char *>(payload.data()), static_cast<std::streamsize>(payload.size()));
+        if (!cacheFile) {
+            std::cout << "Failed to write mesh cache file " << path << "\n";
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::cout << "Failed to write mesh cache file " << path << ": " << error.message() << "\n";
+        std::filesystem::remove(temporaryPath, error);
+    }
+}
+
+}  // namespace rendering
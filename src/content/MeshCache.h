@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+
+#include "MeshData.h"
+
+namespace rendering {
+
+    constexpr uint32_t MESH_CACHE_MAGIC = 0x434d5452;  // "RTMC"
+    constexpr uint32_t MESH_CACHE_VERSION = 5;
+    constexpr uint64_t MESH_CACHE_ALIGNMENT = 4096;
+    constexpr auto MESH_CACHE_EXTENSION = ".mesh";
+
+    struct MeshCacheSection {
+        uint64_t offset;
+        uint64_t count;
+        uint64_t elementSize;
+    };
+
+    /*
+     * Layout of a cache file: this header, then the position, index, short index and vertex data sections, each
+     * starting at a page aligned offset. The payload hash covers everything after the header.
+     */
+    struct MeshCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t fileSize;
+        uint64_t payloadHash;
+        MeshCacheSection positions;
+        MeshCacheSection indices;
+        MeshCacheSection shortIndices;
+        MeshCacheSection vertexData;
+        uint32_t vertexFlags;
+        uint32_t padding;
+    };
+
+    /*
+     * Hands out cache file paths for content hashes and remembers which ones were used, so entries that no longer
+     * match their source (because the file was edited, or the bake parameters changed) can be evicted.
+     */
+    class MeshCache {
+    public:
+        explicit MeshCache(std::filesystem::path root = "models-cache");
+
+        // Thread safe, may be called from the conversion tasks
+        std::filesystem::path getPath(const std::string &modelPath,
+                                      uint64_t key,
+                                      const std::string &extension = MESH_CACHE_EXTENSION);
+
+        /*
+         * Deletes the cache files in every directory touched since the last call that weren't handed out by getPath,
+         * along with their leftover temporary files. Only files with an extension getPath has handed out are
+         * considered, anything else in the directories wasn't written by a cache.
+         */
+        void evictUnused();
+
+    private:
+        std::filesystem::path root;
+        std::mutex mutex;
+        std::map<std::filesystem::path, std::set<std::filesystem::path>> usedFiles;
+        // Extensions of every cache that has asked for a path, mesh and texture cache files so far
+        std::set<std::string> extensions;
+    };
+
+    /*
+     * Unique name next to the path to write its contents under before renaming them into place. Writers of the same
+     * key, on other threads or in other processes, never share it. Keeps the extension in front of .tmp, so eviction
+     * can tell which cache a leftover belongs to.
+     */
+    std::filesystem::path getTemporaryPath(const std::filesystem::path &path);
+
+    // Maps the file and returns spans into the mapping, or nothing if it's missing, outdated or corrupt
+    std::optional<MeshData> readMeshCache(const std::filesystem::path &path);
+
+    void writeMeshCache(const std::filesystem::path &path, const MeshData &meshData);
+
+}  // namespace rendering
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "MappedFile.h"
+
+namespace rendering {
+    // Which of the optional attributes a primitive has, the missing ones are left zeroed in VertexData
+    constexpr uint32_t VERTEX_HAS_NORMALS = 1 << 0;
+    constexpr uint32_t VERTEX_HAS_TANGENTS = 1 << 1;
+
+    // Same layout as PackedVertex in shaders/rt/vertex.glsl, see VertexEncoding.h for the encodings
+    struct VertexData {
+        uint32_t uv;       // Two halfs
+        uint32_t normal;   // Octahedral, two snorm16 components
+        uint32_t tangent;  // Octahedral like the normal, the lowest bit holds the bitangent sign
+    };
+
+    /*
+     * CPU-side geometry of a single primitive, produced on worker threads before it's uploaded. The spans either point
+     * into arrays owned by this object or straight into a memory mapped cache file, so it can only be moved.
+     */
+    class MeshData {
+    public:
+        std::span<const glm::vec3> positions;
+        // Exactly one of the index arrays is used, 16-bit indices whenever every vertex can be addressed with them
+        std::span<const uint32_t> indices;
+        std::span<const uint16_t> shortIndices;
+        std::span<const VertexData> vertexData;
+        uint32_t vertexFlags = 0;
+        // Identifies the source data, equal keys mean interchangeable geometry even across files
+        uint64_t contentKey = 0;
+
+        MeshData() = default;
+
+        MeshData(std::vector<glm::vec3> positions, std::vector<uint32_t> indices, std::vector<VertexData> vertexData)
+                : positionStorage(std::move(positions)),
+                  vertexDataStorage(std::move(vertexData)) {
+            if (positionStorage.size() <= 0x10000) {
+                shortIndexStorage.assign(indices.begin(), indices.end());
+            } else {
+                indexStorage = std::move(indices);
+            }
+            this->positions = positionStorage;
+            this->indices = indexStorage;
+            this->shortIndices = shortIndexStorage;
+            this->vertexData = vertexDataStorage;
+        }
+
+        MeshData(std::unique_ptr<MappedFile> mapping,
+                 std::span<const glm::vec3> positions,
+                 std::span<const uint32_t> indices,
+                 std::span<const uint16_t> shortIndices,
+                 std::span<const VertexData> vertexData)
+                : positions(positions),
+                  indices(indices),
+                  shortIndices(shortIndices),
+                  vertexData(vertexData),
+                  mapping(std::move(mapping)) {
+        }
+
+        MeshData(const MeshData &) = delete;
+
+        MeshData &operator=(const MeshData &) = delete;
+
+        // Moving a vector keeps its heap allocation, so the spans stay valid
+        MeshData(MeshData &&other) noexcept = default;
+
+        MeshData &operator=(MeshData &&other) noexcept = default;
+
+        [[nodiscard]] bool hasShortIndices() const {
+            return indices.empty();
+        }
+
+        [[nodiscard]] size_t indexCount() const {
+            return hasShortIndices() ? shortIndices.size() : indices.size();
+        }
+
+    private:
+        std::vector<glm::vec3> positionStorage;
+        std::vector<uint32_t> indexStorage;
+        std::vector<uint16_t> shortIndexStorage;
+        std::vector<VertexData> vertexDataStorage;
+        std::unique_ptr<MappedFile> mapping;
+    };
+}  // namespace rendering
@@ -0,0 +1,146 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <glm/common.hpp>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "Hash.h"
+#include "Trace.h"
+
+namespace rendering {
+
+namespace {
+
+struct WeldKey {
+    glm::vec3 position;
+    VertexData vertexData;
+
+    bool operator==(const WeldKey &other) const {
+        return std::memcmp(this, &other, sizeof(WeldKey)) == 0;
+    }
+};
+
+struct WeldKeyHash {
+    size_t operator()(const WeldKey &key) const {
+        return static_cast<size_t>(hashBytes(&key, sizeof(WeldKey)));
+    }
+};
+
+// Spreads the lowest 10 bits of value so there are two zero bits between each of them
+uint32_t expandBits(uint32_t value) {
+    value &= 0x3ff;
+    value = (value | value << 16) & 0x030000ff;
+    value = (value | value << 8) & 0x0300f00f;
+    value = (value | value << 4) & 0x030c30c3;
+    value = (value | value << 2) & 0x09249249;
+    return value;
+}
+
+uint32_t mortonCode(const glm::vec3 &normalized) {
+    const auto quantize = [](float value) {
+        return static_cast<uint32_t>(std::clamp(value * 1023.0f, 0.0f, 1023.0f));
+    };
+    return expandBits(quantize(normalized.x)) << 2 | expandBits(quantize(normalized.y)) << 1 |
+           expandBits(quantize(normalized.z));
+}
+
+void weldVertices(const std::vector<glm::vec3> &positions,
+                  const std::vector<VertexData> &vertexData,
+                  std::vector<uint32_t> &indices) {
+    static_assert(sizeof(WeldKey) == sizeof(glm::vec3) + sizeof(VertexData), "WeldKey must not contain padding");
+
+    std::unordered_map<WeldKey, uint32_t, WeldKeyHash> uniqueVertices;
+    uniqueVertices.reserve(positions.size());
+    std::vector<uint32_t> remap(positions.size());
+    for (uint32_t i = 0; i < positions.size(); i++) {
+        // The first copy of every vertex is kept, the unused duplicates are dropped by the final renumbering
+        remap[i] = uniqueVertices.try_emplace(WeldKey{positions[i], vertexData[i]}, i).first->second;
+    }
+
+    std::vector<uint32_t> welded;
+    welded.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const auto a = remap[indices[i]];
+        const auto b = remap[indices[i + 1]];
+        const auto c = remap[indices[i + 2]];
+        if (a != b && b != c && a != c) {
+            welded.insert(welded.end(), {a, b, c});
+        }
+    }
+    indices = std::move(welded);
+}
+
+void sortTriangles(const std::vector<glm::vec3> &positions, std::vector<uint32_t> &indices) {
+    const auto triangleCount = indices.size() / 3;
+    if (triangleCount < 2) {
+        return;
+    }
+
+    glm::vec3 low(std::numeric_limits<float>::max());
+    glm::vec3 high(std::numeric_limits<float>::lowest());
+    std::vector<glm::vec3> centroids(triangleCount);
+    for (size_t i = 0; i < triangleCount; i++) {
+        centroids[i] =
+            (positions[indices[i * 3]] + positions[indices[i * 3 + 1]] + positions[indices[i * 3 + 2]]) / 3.0f;
+        low = glm::min(low, centroids[i]);
+        high = glm::max(high, centroids[i]);
+    }
+    // Flat meshes would divide by zero along their flat axis
+    const auto extent = glm::max(high - low, glm::vec3(1e-6f));
+
+    std::vector<std::pair<uint32_t, uint32_t>> keys(triangleCount);
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        keys[i] = {mortonCode((centroids[i] - low) / extent), i};
+    }
+    // Ties keep their authored order
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<uint32_t> sorted(indices.size());
+    for (size_t i = 0; i < triangleCount; i++) {
+        std::copy_n(indices.begin() + keys[i].second * 3, 3, sorted.begin() + i * 3);
+    }
+    indices = std::move(sorted);
+}
+
+void renumberVertices(std::vector<glm::vec3> &positions,
+                      std::vector<VertexData> &vertexData,
+                      std::vector<uint32_t> &indices) {
+    constexpr auto unused = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> remap(positions.size(), unused);
+    std::vector<glm::vec3> newPositions;
+    std::vector<VertexData> newVertexData;
+    newPositions.reserve(positions.size());
+    newVertexData.reserve(vertexData.size());
+    for (auto &index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<uint32_t>(newPositions.size());
+            newPositions.push_back(positions[index]);
+            newVertexData.push_back(vertexData[index]);
+        }
+        index = remap[index];
+    }
+    positions = std::move(newPositions);
+    vertexData = std::move(newVertexData);
+}
+
+}  // namespace
+
+void optimizeMesh(std::vector<glm::vec3> &positions,
+                  std::vector<VertexData> &vertexData,
+                  std::vector<uint32_t> &indices) {
+    TRACE_SCOPE("Optimize mesh");
+    // Indices past the end of the vertex arrays would be read out of bounds by every step
+    const auto vertexCount = static_cast<uint32_t>(positions.size());
+    if (std::any_of(indices.begin(), indices.end(), [&](uint32_t index) { return index >= vertexCount; })) {
+        throw std::runtime_error("Primitive references a vertex that doesn't exist");
+    }
+
+    weldVertices(positions, vertexData, indices);
+    sortTriangles(positions, indices);
+    renumberVertices(positions, vertexData, indices);
+}
+
+}  // namespace rendering
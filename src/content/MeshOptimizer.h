@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <vector>
+
+#include "MeshData.h"
+
+namespace rendering {
+
+    /*
+     * Load-time cleanup of a converted primitive, run before it's written to the mesh cache:
+     *  1. Welds vertices whose position and packed attributes are bit-identical and drops the triangles that collapse
+     *  2. Sorts the triangles along a Morton curve through their centroids, so neighbouring triangles are close in
+     *     memory, which helps both the BLAS builder and the hit shaders' attribute fetches
+     *  3. Renumbers the vertices in the order the sorted triangles first use them and drops unreferenced ones
+     */
+    void optimizeMesh(std::vector<glm::vec3> &positions,
+                      std::vector<VertexData> &vertexData,
+                      std::vector<uint32_t> &indices);
+
+}  // namespace rendering
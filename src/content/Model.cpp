@@ -1,98 +1,49 @@
 #include "Model.h"
 
+#include <glm/common.hpp>
 #include <glm/detail/type_mat3x3.hpp>
 #include <glm/fwd.hpp>
+#include <glm/matrix.hpp>
 #include <glm/vec3.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <numeric>
-#include <fstream>
 #include <filesystem>
 
-namespace rendering {
+#include "AccessorView.h"
+#include "Hash.h"
+#include "MeshOptimizer.h"
+#include "Trace.h"
+#include "VertexEncoding.h"
 
-template <typename T>
-std::vector<T> readDataFromAccessor(const tinygltf::Model &model, uint32_t accessorIndex) {
-    const auto accessor = model.accessors[accessorIndex];
-    const auto bufferView = model.bufferViews[accessor.bufferView];
-    const auto buffer = model.buffers[bufferView.buffer];
-    const auto stride = accessor.ByteStride(bufferView);
-
-    std::vector<T> result;
-    result.reserve(accessor.count);
-    auto offset = bufferView.byteOffset + accessor.byteOffset;
-    for (size_t i = 0; i < accessor.count; i++) {
-        const auto *data = reinterpret_cast<const T *>(buffer.data.data() + offset);
-        offset += stride;
-        result.push_back(*data);
-    }
-    return result;
-}
+namespace rendering {
 
-std::vector<uint32_t> readIndicesAccessor(const tinygltf::Model &model, uint32_t accessorIndex) {
-    const auto accessor = model.accessors[accessorIndex];
-    const auto bufferView = model.bufferViews[accessor.bufferView];
-    const auto buffer = model.buffers[bufferView.buffer];
-
-    auto stride = accessor.ByteStride(bufferView);
-
-    std::vector<uint32_t> result;
-    result.reserve(accessor.count);
-    auto offset = bufferView.byteOffset + accessor.byteOffset;
-    for (size_t i = 0; i < accessor.count; i++) {
-        if (stride == 2) {
-            const auto *data = reinterpret_cast<const uint16_t *>(buffer.data.data() + offset);
-            result.push_back(static_cast<uint32_t>(*data));
-        } else {
-            const auto *data = reinterpret_cast<const uint32_t *>(buffer.data.data() + offset);
-            result.push_back(*data);
+Model::Model(VulkanContext &context, GeometryArena &geometryArena, const MeshData &meshData, bool deformable)
+    : geometry(geometryArena.allocate(context, meshData)),
+      vertexFlags(meshData.vertexFlags),
+      triangleCount(geometry.indexCount / 3),
+      bounds{glm::vec3(0.0f), glm::vec3(0.0f)} {
+    if (!meshData.positions.empty()) {
+        bounds = {meshData.positions[0], meshData.positions[0]};
+        for (const auto &position : meshData.positions) {
+            bounds.min = glm::min(bounds.min, position);
+            bounds.max = glm::max(bounds.max, position);
         }
-        offset += stride;
     }
-    return result;
-}
-
-Model::Model(VulkanContext &context,
-             const std::vector<glm::vec3> &positions,
-             const std::vector<uint32_t> &indices,
-             const std::vector<VertexData> &vertexData,
-             int32_t baseColorId,
-             int32_t normalId,
-             int32_t metallicRoughnessId,
-             int32_t emissiveId)
-    : baseColorId(baseColorId),
-      normalId(normalId),
-      metallicRoughnessId(metallicRoughnessId),
-      emissiveId(emissiveId),
-      triangleCount(indices.size() / 3) {
-    positionBuffer = std::make_unique<Buffer>(context,
-                                              positions.size() * sizeof(glm::vec3),
-                                              vk::BufferUsageFlagBits::eShaderDeviceAddress |
-                                                  vk::BufferUsageFlagBits::eStorageBuffer |
-                                                  vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
-                                              positions.data());
-    indexBuffer = std::make_unique<Buffer>(context,
-                                           indices.size() * sizeof(uint32_t),
-                                           vk::BufferUsageFlagBits::eShaderDeviceAddress |
-                                               vk::BufferUsageFlagBits::eStorageBuffer |
-                                               vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
-                                           indices.data());
-    vertexDataBuffer = std::make_unique<Buffer>(
-        context,
-        vertexData.size() * sizeof(VertexData),
-        vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer,
-        vertexData.data());
 
+    // The BLAS reads the model's range of the chunk directly, indices stay relative to the first vertex
+    const auto &chunk = geometryArena.chunks[geometry.chunk];
     vk::AccelerationStructureGeometryTrianglesDataKHR trianglesData{
         vk::Format::eR32G32B32Sfloat,
-        {positionBuffer->deviceAddress()},
+        {chunk.positionBuffer->deviceAddress() + geometry.firstVertex * sizeof(glm::vec3)},
         sizeof(glm::vec3),
-        50000,
-        vk::IndexType::eUint32,
-        {
-                                    indexBuffer->deviceAddress(),
-                                    },
+        geometry.vertexCount > 0 ? geometry.vertexCount - 1 : 0,
+        geometry.shortIndices ? vk::IndexType::eUint16 : vk::IndexType::eUint32,
+        {chunk.indexBuffer->deviceAddress() + geometry.firstIndexWord * sizeof(uint32_t)},
     };
 
-    vk::AccelerationStructureGeometryKHR geometry{
+    vk::AccelerationStructureGeometryKHR blasGeometry{
         vk::GeometryTypeKHR::eTriangles,
         vk::AccelerationStructureGeometryDataKHR{
                                                  trianglesData,
@@ -100,147 +51,172 @@ Model::Model(VulkanContext &context,
         vk::GeometryFlagBitsKHR::eNoDuplicateAnyHitInvocation,
     };
 
+    // Built together with the rest of the scene's BLASes in Scene::build
     blas = std::make_unique<AccelerationStructure>(
-        context, geometry, indices.size() / 3, vk::AccelerationStructureTypeKHR::eBottomLevel);
+        context,
+        blasGeometry,
+        triangleCount,
+        vk::AccelerationStructureTypeKHR::eBottomLevel,
+        deformable ? vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastBuild |
+                         vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate
+                   : vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
+                         vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction);
 }
 
-Model Model::fromGLTFPrimitve(
-        VulkanContext &context,
-        const std::string &modelPath,
-        const std::string &uniquePrimitiveID,
-        const tinygltf::Model &model,
-        const tinygltf::Primitive &primitive,
-        TextureCache &textureCache,
-        const glm::mat4 &transform
-) {
-    auto texcoordIndex = -1;
-    auto baseColorId = -1;
-    auto normalId = -1;
-    auto metallicRoughnessId = -1;
-    auto emissiveId = -1;
-    if (primitive.material >= 0) {
-        const auto &material = model.materials[primitive.material];
-        texcoordIndex = material.pbrMetallicRoughness.baseColorTexture.texCoord;
-        if (material.pbrMetallicRoughness.baseColorTexture.index > 0) {
-            baseColorId = textureCache.loadImage(
-                context, model, material.pbrMetallicRoughness.baseColorTexture.index, vk::Format::eR8G8B8A8Unorm);
-        } else if (!material.pbrMetallicRoughness.baseColorFactor.empty()) {
-            auto red = static_cast<int8_t>(material.pbrMetallicRoughness.baseColorFactor[0] * 255.0);
-            auto green = static_cast<int8_t>(material.pbrMetallicRoughness.baseColorFactor[1] * 255.0);
-            auto blue = static_cast<int8_t>(material.pbrMetallicRoughness.baseColorFactor[2] * 255.0);
-            baseColorId = textureCache.create1x1Texture(context, red, green, blue, 255, vk::Format::eR8G8B8A8Unorm);
-        }
-
-        if (material.normalTexture.index >= 0) {
-            normalId = textureCache.loadImage(context, model, material.normalTexture.index);
+namespace {
+
+// Accessors a primitive's baked geometry is built from. Attributes the primitive doesn't have are left empty.
+struct PrimitiveSources {
+    RawAccessor positions;
+    RawAccessor uvs;
+    RawAccessor normals;
+    RawAccessor tangents;
+    RawAccessor indices;
+    bool deformable;
+
+    static PrimitiveSources fromGLTF(const tinygltf::Model &model, const tinygltf::Primitive &primitive, bool deformable) {
+        auto texcoordIndex = -1;
+        if (primitive.material >= 0) {
+            texcoordIndex = model.materials[primitive.material].pbrMetallicRoughness.baseColorTexture.texCoord;
         }
+        const auto getAttribute = [&](const std::string &name) {
+            const auto it = primitive.attributes.find(name);
+            return it == primitive.attributes.end() ? RawAccessor{} : RawAccessor::fromGLTF(model, it->second);
+        };
+        return {
+            .positions = getAttribute("POSITION"),
+            .uvs = getAttribute(std::format("TEXCOORD_{}", texcoordIndex)),
+            .normals = getAttribute("NORMAL"),
+            .tangents = getAttribute("TANGENT"),
+            .indices = primitive.indices >= 0 ? RawAccessor::fromGLTF(model, primitive.indices) : RawAccessor{},
+            .deformable = deformable,
+        };
+    }
 
-        if (material.pbrMetallicRoughness.metallicRoughnessTexture.index >= 0) {
-            metallicRoughnessId =
-                textureCache.loadImage(context, model, material.pbrMetallicRoughness.metallicRoughnessTexture.index);
-        } else {
-            auto roughness = static_cast<int8_t>(material.pbrMetallicRoughness.roughnessFactor * 255.0);
-            auto metallic = static_cast<int8_t>(material.pbrMetallicRoughness.roughnessFactor * 255.0);
-            metallicRoughnessId = textureCache.create1x1Texture(context, 0, roughness, metallic, 255);
+    // Covers everything the baked output depends on: the source bytes, their layout and the bake parameters
+    [[nodiscard]] uint64_t hash() const {
+        auto result = static_cast<uint64_t>(MESH_CACHE_VERSION);
+        // Deformable primitives skip the optimizer, so their baked layout differs from the static one
+        if (deformable) {
+            result = hashBytes(&deformable, sizeof(deformable), result);
         }
-
-        if (material.emissiveTexture.index >= 0) {
-            emissiveId = textureCache.loadImage(context, model, material.emissiveTexture.index);
-        } else if (!material.emissiveFactor.empty() && (material.emissiveFactor[0] != 0.0 || material.emissiveFactor[1] != 0.0 || material.emissiveFactor[2] != 0.0)) {
-            auto red = static_cast<int8_t>(material.emissiveFactor[0] * 255.0);
-            auto green = static_cast<int8_t>(material.emissiveFactor[1] * 255.0);
-            auto blue = static_cast<int8_t>(material.emissiveFactor[2] * 255.0);
-            emissiveId = textureCache.create1x1Texture(context, red, green, blue, 255);
+        for (const auto *accessor : {&positions, &uvs, &normals, &tangents, &indices}) {
+            result = accessor->hash(result);
         }
+        return result;
     }
+};
 
-    const auto cacheFilePath = "models-cache/" + modelPath + "/" + uniquePrimitiveID + ".dat";
-    if (std::filesystem::exists(cacheFilePath)) {
-        std::ifstream cacheFile(cacheFilePath, std::ios::binary);
-        std::istreambuf_iterator<char> it(cacheFile);
+}  // namespace
 
-        size_t positionsSize, indicesSize, vertexDataSize;
-        cacheFile.read(reinterpret_cast<char *>(&positionsSize), sizeof(size_t));
-        cacheFile.read(reinterpret_cast<char *>(&indicesSize), sizeof(size_t));
-        cacheFile.read(reinterpret_cast<char *>(&vertexDataSize), sizeof(size_t));
+MeshData Model::loadGLTFPrimitive(
+        MeshCache &meshCache,
+        const std::string &modelPath,
+        const tinygltf::Model &model,
+        const tinygltf::Primitive &primitive,
+        bool deformable
+) {
+    TRACE_SCOPE("Load primitive");
+    const auto sources = PrimitiveSources::fromGLTF(model, primitive, deformable);
+
+    // Instances apply their transforms in the shaders, so the key only depends on the source data
+    const auto contentKey = sources.hash();
+    const auto cacheFilePath = meshCache.getPath(modelPath, contentKey);
+    if (auto cached = readMeshCache(cacheFilePath)) {
+        cached->contentKey = contentKey;
+        return std::move(*cached);
+    }
 
-        std::vector<glm::vec3> positions;
-        std::vector<uint32_t> indices;
-        std::vector<VertexData> vertexData;
-        positions.resize(positionsSize);
-        indices.resize(indicesSize);
-        vertexData.resize(vertexDataSize);
+    // Views read straight out of the model's buffers, the only copies made are into the final arrays
+    const AccessorView<glm::vec3> positionView(sources.positions);
+    const auto vertexCount = positionView.size();
 
-        cacheFile.read(reinterpret_cast<char *>(positions.data()), static_cast<uint32_t>(positionsSize * sizeof(glm::vec3)));
-        cacheFile.read(reinterpret_cast<char *>(indices.data()), static_cast<uint32_t>(indicesSize * sizeof(uint32_t)));
-        cacheFile.read(reinterpret_cast<char *>(vertexData.data()), static_cast<uint32_t>(vertexDataSize * sizeof(VertexData)));
+    std::vector<glm::vec3> positions(vertexCount);
+    positionView.copyTo(positions.data(), sizeof(glm::vec3), vertexCount);
 
-        return {context, positions, indices, vertexData, baseColorId, normalId, metallicRoughnessId, emissiveId};
+    // Attributes are read at full precision first, then packed into the compact vertex layout
+    std::vector<glm::vec2> uvs(vertexCount);
+    if (!sources.uvs.empty()) {
+        const AccessorView<glm::vec2> uvView(sources.uvs);
+        uvView.copyTo(uvs.data(), sizeof(glm::vec2), std::min(vertexCount, uvView.size()));
     }
-
-    std::vector positions = readDataFromAccessor<glm::vec3>(model, primitive.attributes.at("POSITION"));
-    std::vector<glm::vec2> uvs;
+    uint32_t vertexFlags = 0;
     std::vector<glm::vec3> normals;
-    std::vector<glm::vec3> tangents;
-    std::vector<uint32_t> indices;
-    const auto texcoordName = std::format("TEXCOORD_{}", texcoordIndex);
-
-    if (primitive.attributes.contains(texcoordName)) {
-        uvs = readDataFromAccessor<glm::vec2>(model, primitive.attributes.at(texcoordName));
+    if (!sources.normals.empty()) {
+        normals.resize(vertexCount);
+        const AccessorView<glm::vec3> normalView(sources.normals);
+        normalView.copyTo(normals.data(), sizeof(glm::vec3), std::min(vertexCount, normalView.size()));
+        vertexFlags |= VERTEX_HAS_NORMALS;
     }
-    if (primitive.attributes.contains("NORMAL")) {
-        normals = readDataFromAccessor<glm::vec3>(model, primitive.attributes.at("NORMAL"));
+    std::vector<glm::vec3> tangents;
+    if (!sources.tangents.empty()) {
+        tangents.resize(vertexCount);
+        const AccessorView<glm::vec3> tangentView(sources.tangents);
+        tangentView.copyTo(tangents.data(), sizeof(glm::vec3), std::min(vertexCount, tangentView.size()));
+        vertexFlags |= VERTEX_HAS_TANGENTS;
     }
-    if (primitive.attributes.contains("TANGENT")) {
-        tangents = readDataFromAccessor<glm::vec3>(model, primitive.attributes.at("TANGENT"));
+    // glTF keeps the bitangent sign in the tangent's w, mirroring instance transforms are handled in the shaders
+    const auto getBitangentSign = [&](size_t vertex) {
+        if (sources.tangents.componentCount < 4 || vertex >= sources.tangents.count) {
+            return 1.0f;
+        }
+        float w;
+        std::memcpy(&w, sources.tangents.data + vertex * sources.tangents.stride + 3 * sizeof(float), sizeof(float));
+        return w < 0.0f ? -1.0f : 1.0f;
+    };
+
+    std::vector<VertexData> vertexData(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        vertexData[i] = VertexData{
+            .uv = encodeUV(uvs[i]),
+            .normal = normals.empty() ? 0 : encodeOctahedral(normals[i]),
+            .tangent = tangents.empty() ? 0 : encodeTangent(tangents[i], getBitangentSign(i)),
+        };
     }
 
-    if (primitive.indices >= 0) {
-        indices = readIndicesAccessor(model, primitive.indices);
+    std::vector<uint32_t> indices;
+    if (!sources.indices.empty()) {
+        indices.resize(sources.indices.count);
+        widenIndices(sources.indices, indices.data());
     } else {
-        indices.resize(positions.size());
+        indices.resize(vertexCount);
         // Fill in the indices with sequential numbers
         std::iota(indices.begin(), indices.end(), 0);
     }
 
-    glm::mat3 normalMatrix = glm::inverse(glm::transpose(glm::mat3(transform)));
-
-    std::vector<VertexData> vertexData;
-    for (size_t i = 0; i < positions.size(); i++) {
-        vertexData.push_back(VertexData{
-            uvs.size() > i ? uvs[i] : glm::vec2(0.0, 0.0),
-            normalMatrix * (normals.size() > i ? normals[i] : glm::vec3(0.0f, 0.0f, 0.0f)),
-            normalMatrix * (tangents.size() > i ? tangents[i] : glm::vec3(0.0f, 0.0f, 0.0f))
-        });
+    if (!deformable) {
+        optimizeMesh(positions, vertexData, indices);
+    } else if (std::ranges::any_of(indices, [&](uint32_t index) { return index >= vertexCount; })) {
+        // The optimizer checks this for the static primitives
+        throw std::runtime_error("Primitive references a vertex that doesn't exist");
     }
 
-    std::filesystem::create_directories("models-cache/" + modelPath + "/");
-    std::ofstream cacheFile(cacheFilePath, std::ios::binary);
-
-    size_t positionsSize = positions.size();
-    size_t indicesSize = indices.size();
-    size_t vertexDataSize = vertexData.size();
-
-    cacheFile.write(reinterpret_cast<const char *>(&positionsSize), sizeof(size_t));
-    cacheFile.write(reinterpret_cast<const char *>(&indicesSize), sizeof(size_t));
-    cacheFile.write(reinterpret_cast<const char *>(&vertexDataSize), sizeof(size_t));
-
-    cacheFile.write(reinterpret_cast<const char *>(positions.data()), static_cast<int32_t>(sizeof(positions[0]) * positions.size()));
-    cacheFile.write(reinterpret_cast<const char *>(indices.data()), static_cast<int32_t>(sizeof(indices[0]) * indices.size()));
-    cacheFile.write(reinterpret_cast<const char *>(vertexData.data()), static_cast<int32_t>(sizeof(vertexData[0]) * vertexData.size()));
+    MeshData meshData(std::move(positions), std::move(indices), std::move(vertexData));
+    meshData.vertexFlags = vertexFlags;
+    meshData.contentKey = contentKey;
+    writeMeshCache(cacheFilePath, meshData);
+    // Until it's merged the primitive waits as a mapping of the cache file, which the OS can page out
+    if (auto cached = readMeshCache(cacheFilePath)) {
+        cached->contentKey = contentKey;
+        return std::move(*cached);
+    }
+    return meshData;
+}
 
-    return {context, positions, indices, vertexData, baseColorId, normalId, metallicRoughnessId, emissiveId};
+Model Model::fromGLTFPrimitve(
+        VulkanContext &context,
+        GeometryArena &geometryArena,
+        const MeshData &meshData,
+        bool deformable
+) {
+    return {context, geometryArena, meshData, deformable};
 }
 
 Model::Model(Model &&other) noexcept
-    : positionBuffer(std::move(other.positionBuffer)),
-      indexBuffer(std::move(other.indexBuffer)),
-      vertexDataBuffer(std::move(other.vertexDataBuffer)),
+    : geometry(other.geometry),
       blas(std::move(other.blas)),
-      baseColorId(other.baseColorId),
-      normalId(other.normalId),
-      metallicRoughnessId(other.metallicRoughnessId),
-      emissiveId(other.emissiveId),
-      triangleCount(other.triangleCount) {}
+      vertexFlags(other.vertexFlags),
+      triangleCount(other.triangleCount),
+      bounds(other.bounds) {}
 
 }  // namespace rendering
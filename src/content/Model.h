@@ -4,32 +4,34 @@
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <memory>
+#include <span>
 #include "tiny_gltf.h"
 #include "AccelerationStructure.h"
-#include "TextureCache.h"
+#include "GeometryArena.h"
+#include "MeshCache.h"
+#include "MeshData.h"
 
 namespace rendering {
-    struct VertexData {
-        glm::vec2 uv;
-        glm::vec3 normal;
-        glm::vec3 tangent;
+
+    struct Bounds {
+        glm::vec3 min;
+        glm::vec3 max;
     };
 
     class Model {
     public:
-        std::unique_ptr<Buffer> positionBuffer;
-        std::unique_ptr<Buffer> indexBuffer;
-        std::unique_ptr<Buffer> vertexDataBuffer;
+        GeometryAllocation geometry;
         std::unique_ptr<AccelerationStructure> blas;
-        int32_t baseColorId;
-        int32_t normalId;
-        int32_t metallicRoughnessId;
-        int32_t emissiveId;
+        uint32_t vertexFlags;
         uint32_t triangleCount;
+        // Object space bounds of the positions the model was created with
+        Bounds bounds;
 
-        Model(VulkanContext &context, const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices,
-              const std::vector<VertexData> &vertexData, int32_t baseColorId, int32_t normalId,
-              int32_t metallicRoughnessId, int32_t emissiveId);
+        /*
+         * Deformable models get a BLAS that can be refit after the skinning pass rewrote their vertices, instead of
+         * one that is compacted after its first build.
+         */
+        Model(VulkanContext &context, GeometryArena &geometryArena, const MeshData &meshData, bool deformable = false);
 
         Model(const Model &) = delete;
 
@@ -37,15 +39,26 @@ namespace rendering {
 
         Model(Model &&other) noexcept;
 
-        static Model
-        fromGLTFPrimitve(
-                VulkanContext &context,
+        /*
+         * Reads and converts the accessors of a primitive into object space, or loads the result from the mesh cache if
+         * the source data hasn't changed. Doesn't touch the GPU, so it's safe to call from any thread. Deformable
+         * primitives keep the vertex order of the file, the skinning pass addresses their vertices by it.
+         */
+        static MeshData
+        loadGLTFPrimitive(
+                MeshCache &meshCache,
                 const std::string &modelPath,
-                const std::string &uniquePrimitiveID,
                 const tinygltf::Model &model,
                 const tinygltf::Primitive &primitive,
-                TextureCache &textureCache,
-                const glm::mat4 &transform
+                bool deformable = false
+        );
+
+        static Model
+        fromGLTFPrimitve(
+                VulkanContext &context,
+                GeometryArena &geometryArena,
+                const MeshData &meshData,
+                bool deformable = false
         );
     };
 
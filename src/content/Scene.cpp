@@ -1,16 +1,42 @@
 #include "Scene.h"
 
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <glm/common.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <iterator>
+#include <limits>
+#include <set>
 #include <thread>
 #include <utility>
 #include <iostream>
 
+#include "MappedFile.h"
+#include "MemoryUsage.h"
+#include "Trace.h"
+#include "UploadManager.h"
 #include "util.h"
 
 tinygltf::Model loadBinaryGLTFModel(tinygltf::TinyGLTF &loader, const std::string &path) {
+    // Parsing from a mapping saves the copy of the whole file tinygltf would read, only the buffers are copied out
+    const auto file = rendering::MappedFile::open(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    // tinygltf takes a 32-bit length, larger files would be cut off instead of failing
+    if (file->size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error(path + " is larger than 4 GiB, which binary glTF files can't be, split it into "
+                                        "several files or move its buffers out into .bin files");
+    }
     std::string err, warn;
     tinygltf::Model model;
-    bool loadResult = loader.LoadBinaryFromFile(&model, &err, &warn, path);
+    bool loadResult = loader.LoadBinaryFromMemory(&model,
+                                                  &err,
+                                                  &warn,
+                                                  file->data(),
+                                                  static_cast<unsigned int>(file->size()),
+                                                  std::filesystem::path(path).parent_path().string());
     if (!loadResult) {
         throw std::runtime_error("Failed to parse the sponza GLTF file");
     }
@@ -39,93 +65,434 @@ tinygltf::Model loadASCIIGLTFModel(tinygltf::TinyGLTF &loader, const std::string
     return model;
 }
 
+tinygltf::Model loadGLTFModel(const std::string &path) {
+    TRACE_SCOPE("Parse glTF");
+    tinygltf::TinyGLTF loader;
+    // Images are decoded by the texture bake tasks instead of serially while parsing
+    loader.SetImageLoader(rendering::storeEncodedGLTFImage, nullptr);
+    if (path.ends_with(".glb")) {
+        return loadBinaryGLTFModel(loader, path);
+    }
+    return loadASCIIGLTFModel(loader, path);
+}
+
+void collectMeshInstances(const tinygltf::Model &model,
+                          uint32_t nodeId,
+                          const glm::mat4 &parentTransform,
+                          int32_t shaderId,
+                          const std::function<void(uint32_t, uint32_t, const glm::mat4 &, int32_t)> &callback) {
+    const auto &node = model.nodes[nodeId];
+    const auto transform = parentTransform * getLocalTransform(node);
+    if (node.mesh >= 0) {
+        callback(node.mesh, nodeId, transform, shaderId);
+    }
+    for (const auto childId : node.children) {
+        collectMeshInstances(model, childId, transform, 0, callback);
+    }
+}
+
+/*
+ * Frees the buffer and image payloads of a parsed file once the last task reading them lets go of it. Merging only
+ * needs the rest of the model. Nothing is released earlier, tinygltf reads every buffer of the file into memory while
+ * parsing, so the peak of a file is its whole parsed payload.
+ */
+struct GLTFPayload {
+    std::shared_ptr<tinygltf::Model> model;
+
+    explicit GLTFPayload(std::shared_ptr<tinygltf::Model> model) : model(std::move(model)) {}
+
+    GLTFPayload(const GLTFPayload &) = delete;
+
+    GLTFPayload &operator=(const GLTFPayload &) = delete;
+
+    ~GLTFPayload() {
+        for (auto &buffer : model->buffers) {
+            std::vector<unsigned char>().swap(buffer.data);
+        }
+        for (auto &image : model->images) {
+            std::vector<unsigned char>().swap(image.image);
+        }
+    }
+};
+
+// While streaming the scene can still be empty, the buffers always get room for at least one element
+template<typename T>
+std::unique_ptr<rendering::Buffer> createSceneBuffer(rendering::VulkanContext &context,
+                                                     const std::vector<T> &elements,
+                                                     vk::BufferUsageFlags usage,
+                                                     rendering::MemoryClass memoryClass = rendering::MemoryClass::Static) {
+    auto buffer = std::make_unique<rendering::Buffer>(
+        context, std::max<size_t>(elements.size(), 1) * sizeof(T), usage, nullptr, memoryClass);
+    if (!elements.empty()) {
+        buffer->updateData(context, elements.size() * sizeof(T), elements.data());
+    }
+    return buffer;
+}
+
+// Vulkan takes the top three rows of the matrix, row major
+vk::TransformMatrixKHR getInstanceTransform(const glm::mat4 &t) {
+    return vk::TransformMatrixKHR{
+        std::array{
+                   std::array{t[0][0], t[1][0], t[2][0], t[3][0]},
+                   std::array{t[0][1], t[1][1], t[2][1], t[3][1]},
+                   std::array{t[0][2], t[1][2], t[2][2], t[3][2]},
+                   }
+    };
+}
+
+rendering::InstanceDesc getInstanceDesc(const rendering::Object &object) {
+    return rendering::InstanceDesc{
+        object.transform,
+        glm::inverse(glm::transpose(glm::mat3(object.transform))),
+        object.modelId,
+        object.materialId,
+    };
+}
+
+rendering::Bounds getWorldBounds(const rendering::Bounds &bounds, const glm::mat4 &transform) {
+    rendering::Bounds result{glm::vec3(std::numeric_limits<float>::max()),
+                             glm::vec3(std::numeric_limits<float>::lowest())};
+    for (int corner = 0; corner < 8; corner++) {
+        const glm::vec3 point((corner & 1) ? bounds.max.x : bounds.min.x,
+                              (corner & 2) ? bounds.max.y : bounds.min.y,
+                              (corner & 4) ? bounds.max.z : bounds.min.z);
+        const auto transformed = glm::vec3(transform * glm::vec4(point, 1.0f));
+        result.min = glm::min(result.min, transformed);
+        result.max = glm::max(result.max, transformed);
+    }
+    return result;
+}
+
+float getSurfaceArea(const rendering::Bounds &bounds) {
+    const auto extent = bounds.max - bounds.min;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+template<typename T>
+bool isFutureReady(const std::future<T> &future) {
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
 namespace rendering {
 void Scene::loadGLTF(rendering::VulkanContext &context,
                      const std::string &path,
                      int32_t sceneId,
                      glm::mat4 transform,
                      int32_t shaderId) {
+    ThreadPool pool;
+    loadGLTFs(context, pool, {GLTFLoadRequest{path, {GLTFPlacement{sceneId, transform, shaderId}}}});
+}
 
+void Scene::loadGLTFs(VulkanContext &context, ThreadPool &pool, const std::vector<GLTFLoadRequest> &requests) {
+    TRACE_SCOPE("Load scene");
+    std::deque<std::future<GLTFImport>> plannedImports;
+    size_t nextRequest = 0;
+    while (nextRequest < requests.size() && plannedImports.size() < MAX_GLTF_FILES_IN_FLIGHT) {
+        plannedImports.push_back(submitGLTFImport(pool, requests[nextRequest++], context.textureCompressionBC));
+    }
+    while (!plannedImports.empty()) {
+        auto gltfImport = plannedImports.front().get();
+        plannedImports.pop_front();
+        // The next file starts loading while this one is merged
+        if (nextRequest < requests.size()) {
+            plannedImports.push_back(submitGLTFImport(pool, requests[nextRequest++], context.textureCompressionBC));
+        }
 
-    tinygltf::TinyGLTF loader;
-    tinygltf::Model model;
-    if (path.ends_with(".glb")) {
-        model = loadBinaryGLTFModel(loader, path);
-    } else {
-        model = loadASCIIGLTFModel(loader, path);
-    }
-
-    textureCache.nextModel();
-    if (sceneId == -1) {
-        sceneId = model.defaultScene;
-    }
-    std::map<uint32_t, std::vector<uint32_t>> modelMap;
-    const auto scene = model.scenes[sceneId];
-    int32_t count = 0;
-    for (const auto &nodeId : scene.nodes) {
-        addNode(context, path, model, nodeId, transform, modelMap, shaderId, count);
-    }
-    context.device->waitIdle();
-}
-
-void Scene::addNode(
-        VulkanContext &context,
-        const std::string &path,
-        const tinygltf::Model &model,
-        uint32_t nodeId,
-        glm::mat4 parentTransform,
-        std::map<uint32_t, std::vector<uint32_t>> &modelMap,
-        int32_t shaderId,
-        int32_t &count
-) {
-    const auto node = model.nodes[nodeId];
-    glm::mat4 localTransform = getLocalTransform(node);
-    const auto transform = parentTransform * localTransform;
-    if (node.mesh >= 0) {
-        if (!modelMap.contains(node.mesh)) {
-            std::vector<uint32_t> modelIds;
-            const auto mesh = model.meshes[node.mesh];
-            for (size_t i = 0; i < mesh.primitives.size(); i++) {
-                const auto &primitive = mesh.primitives[i];
-                count++;
-                std::cout << "Creating model " << count << "\n";
-                auto m = Model::fromGLTFPrimitve(
-                        context,
-                        path,
-                        std::to_string(node.mesh) + "_" + std::to_string(i),
-                        model,
-                        primitive,
-                        textureCache,
-                        transform
-                );
-                modelIds.push_back(addModel(m));
+        // GPU resources are created on this thread only, in request order, so object ids stay deterministic
+        mergeGLTFImport(context, gltfImport);
+    }
+    context.uploads->flush();
+    finishLoading();
+}
+
+void Scene::streamGLTFs(VulkanContext &context, ThreadPool &pool, const std::vector<GLTFLoadRequest> &requests) {
+    streamingPool = &pool;
+    queuedRequests.insert(queuedRequests.end(), requests.begin(), requests.end());
+    submitQueuedGLTFs(context);
+}
+
+void Scene::submitQueuedGLTFs(VulkanContext &context) {
+    while (!queuedRequests.empty() && streamedGLTFs.size() < MAX_GLTF_FILES_IN_FLIGHT) {
+        streamedGLTFs.push_back(StreamedGLTF{
+            .plannedImport =
+                submitGLTFImport(*streamingPool, queuedRequests.front(), context.textureCompressionBC),
+        });
+        queuedRequests.pop_front();
+    }
+}
+
+std::future<Scene::GLTFImport> Scene::submitGLTFImport(ThreadPool &pool,
+                                                       const GLTFLoadRequest &request,
+                                                       bool compressTextures) {
+    // Planning only submits more tasks, so doing it on the worker that parsed the file can't deadlock the pool
+    return pool.submit([this, &pool, request, compressTextures]() {
+        return planGLTFImport(
+            pool, request, std::make_shared<tinygltf::Model>(loadGLTFModel(request.path)), compressTextures);
+    });
+}
+
+bool Scene::updateStreaming(VulkanContext &context, std::chrono::milliseconds budget) {
+    const auto start = std::chrono::steady_clock::now();
+    size_t mergedCount = 0;
+    while (!streamedGLTFs.empty() && std::chrono::steady_clock::now() - start < budget) {
+        auto &streamed = streamedGLTFs.front();
+        if (!streamed.gltfImport) {
+            if (!isFutureReady(streamed.plannedImport)) {
+                break;
             }
-            modelMap[node.mesh] = modelIds;
+            streamed.gltfImport = streamed.plannedImport.get();
         }
-        for (const auto &modelId : modelMap.at(node.mesh)) {
-            addObject(modelId, shaderId, transform);
+        // Files are published in request order, a slow file holds back the ones after it to keep object ids stable
+        if (!isReady(*streamed.gltfImport)) {
+            break;
         }
+        mergeGLTFImport(context, *streamed.gltfImport);
+        streamedGLTFs.pop_front();
+        submitQueuedGLTFs(context);
+        mergedCount++;
     }
-    std::ranges::for_each(node.children,
-                          [&](const auto childId) {
-                              addNode(
-                                      context,
-                                      path,
-                                      model,
-                                      childId,
-                                      transform,
-                                      modelMap,
-                                      0,
-                                      count
-                              ); });
+    if (mergedCount == 0) {
+        return false;
+    }
+
+    context.uploads->flush();
+    build(context);
+    std::cout << "Published " << mergedCount << " files, " << streamedGLTFs.size() + queuedRequests.size()
+              << " still loading\n";
+    if (!isStreaming()) {
+        finishLoading();
+    }
+    return true;
+}
+
+void Scene::finishLoading() {
+    meshCache.evictUnused();
+    std::cout << "Scene uses " << textureCache.images.size() << " unique textures\n";
+    std::cout << "Peak memory usage while loading: " << getPeakMemoryUsage() / (1024 * 1024) << " MiB\n";
+}
+
+bool Scene::isStreaming() const {
+    return !streamedGLTFs.empty() || !queuedRequests.empty();
+}
+
+bool Scene::isReady(const GLTFImport &gltfImport) {
+    for (const auto &[meshId, futures] : gltfImport.primitives) {
+        if (!std::ranges::all_of(futures, [](const auto &future) { return isFutureReady(future); })) {
+            return false;
+        }
+    }
+    for (const auto &[meshId, futures] : gltfImport.deformations) {
+        if (!std::ranges::all_of(futures, [](const auto &future) { return isFutureReady(future); })) {
+            return false;
+        }
+    }
+    return std::ranges::all_of(gltfImport.textures,
+                               [](const auto &texture) { return isFutureReady(texture.second); });
 }
 
-void Scene::addObject(uint32_t modelId, uint32_t shaderId, const glm::mat4 &transform) {
-    if (models[modelId].emissiveId >= 0) {
+Scene::GLTFImport Scene::planGLTFImport(ThreadPool &pool,
+                                        const GLTFLoadRequest &request,
+                                        std::shared_ptr<tinygltf::Model> model,
+                                        bool compressTextures) {
+    TRACE_SCOPE("Plan glTF import");
+    // Every task holds on to the payload, the buffers and images are freed as soon as the last task has finished
+    const auto payload = std::make_shared<GLTFPayload>(model);
+    GLTFImport gltfImport{
+        .path = request.path,
+        .model = std::move(model),
+    };
+    const auto &gltfModel = *gltfImport.model;
+    gltfImport.animation = GLTFAnimation::fromGLTF(gltfModel);
+
+    // A mesh on any skinned node or with morph targets is deformed everywhere, each instance gets its own geometry
+    std::set<uint32_t> deformableMeshes;
+    for (const auto &node : gltfModel.nodes) {
+        if (isDeformable(gltfModel, node)) {
+            deformableMeshes.insert(node.mesh);
+        }
+    }
+
+    for (const auto &placement : request.placements) {
+        auto sceneId = placement.sceneId;
+        if (sceneId == -1) {
+            sceneId = std::max(gltfModel.defaultScene, 0);
+        }
+        if (sceneId < 0 || static_cast<size_t>(sceneId) >= gltfModel.scenes.size()) {
+            throw std::runtime_error(request.path + " has no scene " + std::to_string(sceneId));
+        }
+        const auto &scene = gltfModel.scenes[sceneId];
+        for (const auto &nodeId : scene.nodes) {
+            collectMeshInstances(
+                gltfModel, nodeId, placement.transform, placement.shaderId, [&](uint32_t meshId, uint32_t meshNodeId, const glm::mat4 &transform, int32_t shaderId) {
+                    gltfImport.instances.push_back(
+                        MeshInstance{meshId, transform, shaderId, meshNodeId, placement.transform});
+                    // Placements share the conversion of a mesh just like nodes referencing it do
+                    if (gltfImport.primitives.contains(meshId)) {
+                        return;
+                    }
+                    auto &futures = gltfImport.primitives[meshId];
+                    const auto &mesh = gltfModel.meshes[meshId];
+                    const auto deformable = deformableMeshes.contains(meshId);
+                    for (size_t i = 0; i < mesh.primitives.size(); i++) {
+                        futures.push_back(pool.submit([this, path = request.path, meshId, i, deformable, payload]() {
+                            const auto &model = *payload->model;
+                            return Model::loadGLTFPrimitive(
+                                meshCache, path, model, model.meshes[meshId].primitives[i], deformable);
+                        }));
+                        if (deformable) {
+                            gltfImport.deformations[meshId].push_back(pool.submit([meshId, i, payload]() {
+                                const auto &model = *payload->model;
+                                return loadGLTFDeformation(model, model.meshes[meshId].primitives[i]);
+                            }));
+                        }
+                    }
+                });
+        }
+    }
+
+    // Textures are baked next to the primitives, merging only has to upload them
+    for (const auto &key : getMaterialTextures(gltfModel)) {
+        gltfImport.textures[key] = pool.submit([this, path = request.path, key, compressTextures, payload]() {
+            return TextureCache::bakeGLTFTexture(meshCache, path, *payload->model, key, compressTextures);
+        });
+    }
+    return gltfImport;
+}
+
+void Scene::mergeGLTFImport(VulkanContext &context, GLTFImport &gltfImport) {
+    TRACE_SCOPE("Merge glTF");
+    textureCache.nextModel(gltfImport.path, std::move(gltfImport.textures));
+    // Model and material of every primitive of a mesh, the model may come from an earlier file with the same data
+    std::map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> meshPrimitives;
+    // glTF material index to scene material, -1 stands for primitives without a material
+    std::map<int32_t, uint32_t> materialMap;
+    const auto getMaterialId = [&](int32_t materialIndex) {
+        if (!materialMap.contains(materialIndex)) {
+            materialMap[materialIndex] =
+                addMaterial(materialIndex < 0 ? MaterialDesc{}
+                                              : MaterialDesc::fromGLTF(context,
+                                                                       *gltfImport.model,
+                                                                       gltfImport.model->materials[materialIndex],
+                                                                       textureCache));
+        }
+        return materialMap.at(materialIndex);
+    };
+    // Converted geometry and rest pose of every primitive of a deformable mesh, each instance uploads its own copy
+    struct DeformablePrimitive {
+        MeshData meshData;
+        uint32_t materialId;
+        std::shared_ptr<Buffer> restVertices;
+        std::shared_ptr<Buffer> morphDeltas;
+        uint32_t targetCount;
+    };
+    std::map<uint32_t, std::vector<DeformablePrimitive>> deformablePrimitives;
+    constexpr auto deformationUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress;
+    const auto loadDeformablePrimitives = [&](uint32_t meshId) {
+        std::vector<DeformablePrimitive> primitives;
+        const auto &mesh = gltfImport.model->meshes[meshId];
+        auto &futures = gltfImport.primitives.at(meshId);
+        auto &deformationFutures = gltfImport.deformations.at(meshId);
+        for (size_t i = 0; i < mesh.primitives.size(); i++) {
+            auto meshData = futures[i].get();
+            const auto deformation = deformationFutures[i].get();
+            if (deformation.vertices.size() != meshData.positions.size()) {
+                throw std::runtime_error(gltfImport.path + " has a deformed primitive with mismatched attributes");
+            }
+            const auto &vertices = deformation.vertices;
+            const auto &deltas = deformation.morphDeltas;
+            primitives.push_back(DeformablePrimitive{
+                .meshData = std::move(meshData),
+                .materialId = getMaterialId(mesh.primitives[i].material),
+                .restVertices = std::make_shared<Buffer>(context,
+                                                         std::max<size_t>(vertices.size(), 1) * sizeof(DeformableVertex),
+                                                         deformationUsage,
+                                                         vertices.empty() ? nullptr : vertices.data()),
+                .morphDeltas = std::make_shared<Buffer>(context,
+                                                        std::max<size_t>(deltas.size(), 1) * sizeof(MorphDelta),
+                                                        deformationUsage,
+                                                        deltas.empty() ? nullptr : deltas.data()),
+                .targetCount = deformation.targetCount,
+            });
+        }
+        return primitives;
+    };
+
+    auto &animation = gltfImport.animation;
+    const auto animationId = static_cast<uint32_t>(animations.size());
+    for (const auto &instance : gltfImport.instances) {
+        const auto firstObjectId = static_cast<uint32_t>(objects.size());
+        if (gltfImport.deformations.contains(instance.meshId)) {
+            if (!deformablePrimitives.contains(instance.meshId)) {
+                deformablePrimitives[instance.meshId] = loadDeformablePrimitives(instance.meshId);
+            }
+            const auto skin = gltfImport.model->nodes[instance.nodeId].skin;
+            const auto jointCount = skin >= 0 ? animation.getJointCount(skin) : 0;
+            for (const auto &primitive : deformablePrimitives.at(instance.meshId)) {
+                auto m = Model::fromGLTFPrimitve(context, geometryArena, primitive.meshData, true);
+                const auto modelId = addModel(m);
+                addObject(modelId, primitive.materialId, instance.shaderId, instance.transform);
+                deformedObjects.push_back(DeformedObject{
+                    .modelId = modelId,
+                    .animationId = animationId,
+                    .nodeId = instance.nodeId,
+                    .skin = skin,
+                    .vertexCount = static_cast<uint32_t>(primitive.meshData.positions.size()),
+                    .targetCount = primitive.targetCount,
+                    .restVertices = primitive.restVertices,
+                    .morphDeltas = primitive.morphDeltas,
+                    .jointMatrices = std::make_unique<Buffer>(context,
+                                                              std::max<size_t>(jointCount, 1) * sizeof(glm::mat4),
+                                                              deformationUsage,
+                                                              nullptr,
+                                                              MemoryClass::Dynamic),
+                    .morphWeights = std::make_unique<Buffer>(context,
+                                                             std::max<size_t>(primitive.targetCount, 1) * sizeof(float),
+                                                             deformationUsage,
+                                                             nullptr,
+                                                             MemoryClass::Dynamic),
+                });
+            }
+        } else {
+            if (!meshPrimitives.contains(instance.meshId)) {
+                std::vector<std::pair<uint32_t, uint32_t>> primitives;
+                const auto &mesh = gltfImport.model->meshes[instance.meshId];
+                auto &futures = gltfImport.primitives.at(instance.meshId);
+                for (size_t i = 0; i < mesh.primitives.size(); i++) {
+                    const auto meshData = futures[i].get();
+                    if (!modelIndices.contains(meshData.contentKey)) {
+                        std::cout << "Creating model " << models.size() + 1 << "\n";
+                        auto m = Model::fromGLTFPrimitve(context, geometryArena, meshData);
+                        modelIndices[meshData.contentKey] = addModel(m);
+                    }
+                    primitives.emplace_back(modelIndices.at(meshData.contentKey),
+                                            getMaterialId(mesh.primitives[i].material));
+                }
+                meshPrimitives[instance.meshId] = primitives;
+            }
+            for (const auto &[modelId, materialId] : meshPrimitives.at(instance.meshId)) {
+                addObject(modelId, materialId, instance.shaderId, instance.transform);
+            }
+        }
+        if (animation.isNodeAnimated(instance.nodeId)) {
+            for (auto objectId = firstObjectId; objectId < objects.size(); objectId++) {
+                animatedObjects.push_back(
+                    AnimatedObject{objectId, animationId, instance.nodeId, instance.placementTransform});
+            }
+        }
+    }
+    if (!animation.empty()) {
+        animations.push_back(std::move(animation));
+    }
+}
+
+void Scene::addObject(uint32_t modelId, uint32_t materialId, uint32_t shaderId, const glm::mat4 &transform) {
+    if (materials[materialId].isEmissive()) {
         emissiveObjectIds.push_back(objects.size());
     }
     objects.push_back(Object{
         .modelId = modelId,
+        .materialId = materialId,
         .shaderId = shaderId,
         .transform = transform,
     });
@@ -137,35 +504,33 @@ uint32_t Scene::addModel(Model &model) {
     return index;
 }
 
+uint32_t Scene::addMaterial(const MaterialDesc &material) {
+    const auto index = materials.size();
+    materials.push_back(material);
+    return index;
+}
+
 void Scene::build(VulkanContext &context) {
-    // std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos;
-    // std::vector<vk::AccelerationStructureBuildRangeInfoKHR *> buildRangeInfos;
-    // std::vector<Buffer> scratchBuffers;
-    // buildGeometryInfos.reserve(models.size());
-    // buildRangeInfos.reserve(models.size());
-    /*for (const auto &m: models) {
-        Buffer buffer = m.blas->createScratchBuffer(context);
-        m.blas->buildGeometryInfo.scratchData = {.deviceAddress = utils::alignUp(buffer.deviceAddress(), 128)};
-        //buildGeometryInfos.push_back(m.blas->buildGeometryInfo);
-        //buildRangeInfos.push_back(&m.blas->buildRangeInfo);
-        //scratchBuffers.push_back(std::move(buffer));
-        context.createAndSubmitCommandBuffer([&](vk::CommandBuffer cmd) {
-            cmd.buildAccelerationStructuresKHR(m.blas->buildGeometryInfo, &m.blas->buildRangeInfo);
-        });
-    }*/
+    TRACE_SCOPE("Build scene");
+    std::vector<AccelerationStructure *> bottomLevelStructures;
+    bottomLevelStructures.reserve(models.size() - builtModelCount);
+    for (size_t i = builtModelCount; i < models.size(); i++) {
+        bottomLevelStructures.push_back(models[i].blas.get());
+    }
+    AccelerationStructure::buildBatched(context, bottomLevelStructures);
+    // Deformable models keep their BLAS uncompacted, refits need the structure built with eAllowUpdate
+    std::vector<AccelerationStructure *> compactedStructures;
+    std::ranges::copy_if(bottomLevelStructures, std::back_inserter(compactedStructures), [](const auto *structure) {
+        return static_cast<bool>(structure->buildGeometryInfo.flags &
+                                 vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction);
+    });
+    AccelerationStructure::compact(context, compactedStructures);
+    builtModelCount = models.size();
 
     std::vector<vk::AccelerationStructureInstanceKHR> instances;
     for (const auto &object : objects) {
-        const auto t = object.transform;
-        const auto instanceTransform = vk::TransformMatrixKHR{
-            std::array{
-                       std::array{t[0][0], t[1][0], t[2][0], t[3][0]},
-                       std::array{t[0][1], t[1][1], t[2][1], t[3][1]},
-                       std::array{t[0][2], t[1][2], t[2][2], t[3][2]},
-                       }
-        };
         vk::AccelerationStructureInstanceKHR instance{
-            instanceTransform,
+            getInstanceTransform(object.transform),
             {},
             0xFF,
             object.shaderId,
@@ -176,12 +541,13 @@ void Scene::build(VulkanContext &context) {
         instances.push_back(instance);
     }
 
-    instanceBuffer = std::make_unique<Buffer>(context,
-                                              instances.size() * sizeof(vk::AccelerationStructureInstanceKHR),
-                                              vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
-                                                  vk::BufferUsageFlagBits::eStorageBuffer |
-                                                  vk::BufferUsageFlagBits::eShaderDeviceAddress,
-                                              instances.data());
+    // Mapped, so setTransform can write moved instances in place
+    instanceBuffer = createSceneBuffer(context,
+                                       instances,
+                                       vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+                                           vk::BufferUsageFlagBits::eStorageBuffer |
+                                           vk::BufferUsageFlagBits::eShaderDeviceAddress,
+                                       MemoryClass::Dynamic);
 
     vk::AccelerationStructureGeometryInstancesDataKHR instanceData{
         false,
@@ -194,47 +560,193 @@ void Scene::build(VulkanContext &context) {
                                                           vk::GeometryFlagBitsKHR::eNoDuplicateAnyHitInvocation
     };
 
+    // Instances can be moved after the build, see setTransform
     accelerationStructure = std::make_unique<AccelerationStructure>(
-        context, instanceGeometry, instances.size(), vk::AccelerationStructureTypeKHR::eTopLevel);
+        context,
+        instanceGeometry,
+        instances.size(),
+        vk::AccelerationStructureTypeKHR::eTopLevel,
+        vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
+            vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate);
+    accelerationStructure->build(context);
+    resetTLASRefits();
 
-    std::vector<ObjDesc> descriptors;
+    std::vector<GeometryDesc> geometryDescs;
+    geometryDescs.reserve(models.size());
+    for (const auto &model : models) {
+        geometryDescs.push_back(GeometryDesc{
+            model.triangleCount,
+            model.geometry.chunk,
+            model.geometry.firstIndexWord,
+            model.geometry.firstVertex,
+            model.vertexFlags,
+            static_cast<uint32_t>(model.geometry.shortIndices ? vk::IndexType::eUint16 : vk::IndexType::eUint32),
+        });
+    }
+    geometryDescBuffer = createSceneBuffer(context, geometryDescs, vk::BufferUsageFlagBits::eStorageBuffer);
+
+    std::vector<InstanceDesc> instanceDescs;
+    instanceDescs.reserve(objects.size());
     for (const auto &obj : objects) {
-        descriptors.push_back(ObjDesc{obj.transform,
-                                      models[obj.modelId].triangleCount,
-                                      models[obj.modelId].baseColorId,
-                                      models[obj.modelId].normalId,
-                                      models[obj.modelId].metallicRoughnessId,
-                                      models[obj.modelId].emissiveId,
-                                      models[obj.modelId].indexBuffer->deviceAddress(),
-                                      models[obj.modelId].positionBuffer->deviceAddress(),
-                                      models[obj.modelId].vertexDataBuffer->deviceAddress()});
-    }
-    objDescriptorBuffer = std::make_unique<Buffer>(
-        context, descriptors.size() * sizeof(ObjDesc), vk::BufferUsageFlagBits::eStorageBuffer, descriptors.data());
-
-    emissiveObjectIdsBuffer = std::make_unique<Buffer>(
+        instanceDescs.push_back(getInstanceDesc(obj));
+    }
+    instanceDescBuffer = createSceneBuffer(
+        context, instanceDescs, vk::BufferUsageFlagBits::eStorageBuffer, MemoryClass::Dynamic);
+    geometryChunkBuffer =
+        createSceneBuffer(context, geometryArena.getChunkDescs(), vk::BufferUsageFlagBits::eStorageBuffer);
+    materialBuffer = createSceneBuffer(context, materials, vk::BufferUsageFlagBits::eStorageBuffer);
+    emissiveObjectIdsBuffer = createSceneBuffer(
         context,
-        sizeof(uint32_t) * emissiveObjectIds.size(),
-        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-        emissiveObjectIds.data());
+        emissiveObjectIds,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress);
 
-    const vk::SamplerCreateInfo samplerCreateInfo{{},
+    if (!textureStreamer) {
+        textureStreamer = std::make_unique<TextureStreamer>(context);
+    }
+    if (sampler) {
+        return;
+    }
+    vk::SamplerCreateInfo samplerCreateInfo{{},
                                                   vk::Filter::eLinear,
                                                   vk::Filter::eLinear,
                                                   vk::SamplerMipmapMode::eLinear,
                                                   vk::SamplerAddressMode::eRepeat,
                                                   vk::SamplerAddressMode::eRepeat,
                                                   vk::SamplerAddressMode::eRepeat};
+    samplerCreateInfo.setMaxLod(VK_LOD_CLAMP_NONE);
     sampler = context.device->createSamplerUnique(samplerCreateInfo);
 }
 
-Scene::Scene(Scene &&other) noexcept
-    : accelerationStructure(std::move(other.accelerationStructure)),
-      textureCache(std::move(other.textureCache)),
-      objDescriptorBuffer(std::move(other.objDescriptorBuffer)),
-      objects(std::move(other.objects)),
-      shaderPaths(std::move(other.shaderPaths)),
-      models(std::move(other.models)),
-      instanceBuffer(std::move(other.instanceBuffer)) {}
+void Scene::setTransform(VulkanContext &context, uint32_t objectId, const glm::mat4 &transform) {
+    auto &object = objects.at(objectId);
+    object.transform = transform;
+    // Objects added since the last build get their transform when their buffers are created
+    if (objectId >= movedObjects.size()) {
+        return;
+    }
+
+    const auto instanceOffset = objectId * sizeof(vk::AccelerationStructureInstanceKHR);
+    const auto instanceTransform = getInstanceTransform(transform);
+    // The transform is the first member of the instance, the rest of it stays as built
+    instanceBuffer->updateData(context, sizeof(vk::TransformMatrixKHR), &instanceTransform, instanceOffset);
+    const auto instanceDesc = getInstanceDesc(object);
+    instanceDescBuffer->updateData(context, sizeof(InstanceDesc), &instanceDesc, objectId * sizeof(InstanceDesc));
+
+    if (!movedObjects[objectId]) {
+        movedObjects[objectId] = true;
+        movedObjectIds.push_back(objectId);
+    }
+    transformsChanged = true;
+}
+
+void Scene::updateTransforms(VulkanContext &context) {
+    if (!transformsChanged) {
+        return;
+    }
+    TRACE_SCOPE("Update TLAS");
+    /*
+     * Refits keep the grouping of the last build. Nodes grow as their objects drift apart, so the area the moved
+     * objects have swept away from their built bounds estimates how much looser the refit tree is than a fresh one.
+     * Objects animating in place barely add to it, no matter how many of them there are.
+     */
+    auto grownSurfaceArea = 0.0f;
+    for (const auto objectId : movedObjectIds) {
+        const auto &object = objects[objectId];
+        const auto &built = builtObjectBounds[objectId];
+        const auto current = getWorldBounds(models[object.modelId].bounds, object.transform);
+        const Bounds swept{glm::min(built.min, current.min), glm::max(built.max, current.max)};
+        grownSurfaceArea += getSurfaceArea(swept) - getSurfaceArea(built);
+    }
+    const auto growth = builtSurfaceArea > 0.0f ? grownSurfaceArea / builtSurfaceArea : 0.0f;
+    if (tlasRefitCount >= MAX_TLAS_REFITS || growth > TLAS_REBUILD_BOUNDS_GROWTH) {
+        accelerationStructure->build(context);
+        resetTLASRefits();
+    } else {
+        accelerationStructure->update(context);
+        tlasRefitCount++;
+        transformsChanged = false;
+    }
+}
+
+void Scene::resetTLASRefits() {
+    tlasRefitCount = 0;
+    transformsChanged = false;
+    movedObjects.assign(objects.size(), false);
+    movedObjectIds.clear();
+    builtObjectBounds.clear();
+    builtObjectBounds.reserve(objects.size());
+    builtSurfaceArea = 0.0f;
+    for (const auto &object : objects) {
+        builtObjectBounds.push_back(getWorldBounds(models[object.modelId].bounds, object.transform));
+        builtSurfaceArea += getSurfaceArea(builtObjectBounds.back());
+    }
+}
+
+void Scene::animate(VulkanContext &context, float time) {
+    if (animations.empty()) {
+        return;
+    }
+    TRACE_SCOPE("Animate scene");
+    std::vector<bool> changed(animations.size());
+    for (size_t i = 0; i < animations.size(); i++) {
+        changed[i] = animations[i].evaluate(time);
+    }
+
+    for (const auto &animated : animatedObjects) {
+        if (changed[animated.animationId]) {
+            const auto &animation = animations[animated.animationId];
+            setTransform(context,
+                         animated.objectId,
+                         animated.placementTransform * animation.getGlobalTransform(animated.nodeId));
+        }
+    }
+
+    std::vector<SkinningDispatch> dispatches;
+    std::vector<AccelerationStructure *> structures;
+    for (auto &deformed : deformedObjects) {
+        // Streamed models are deformed from the first frame after their BLAS has been built
+        if (!changed[deformed.animationId] || deformed.modelId >= builtModelCount) {
+            continue;
+        }
+        const auto &animation = animations[deformed.animationId];
+        if (deformed.skin >= 0) {
+            const auto jointMatrices = animation.getJointMatrices(deformed.skin, deformed.nodeId);
+            deformed.jointMatrices->updateData(
+                context, jointMatrices.size() * sizeof(glm::mat4), jointMatrices.data());
+        }
+        if (deformed.targetCount > 0) {
+            // Primitives of a mesh can have fewer targets than the mesh has weights, missing weights are zero
+            std::vector<float> weights(deformed.targetCount, 0.0f);
+            const auto nodeWeights = animation.getWeights(deformed.nodeId);
+            std::copy_n(nodeWeights.begin(), std::min(nodeWeights.size(), weights.size()), weights.begin());
+            deformed.morphWeights->updateData(context, weights.size() * sizeof(float), weights.data());
+        }
+
+        const auto &model = models[deformed.modelId];
+        auto &chunk = geometryArena.chunks[model.geometry.chunk];
+        dispatches.push_back(SkinningDispatch{
+            .restVertices = deformed.restVertices->deviceAddress(),
+            .morphDeltas = deformed.morphDeltas->deviceAddress(),
+            .jointMatrices = deformed.jointMatrices->deviceAddress(),
+            .morphWeights = deformed.morphWeights->deviceAddress(),
+            .positions = chunk.positionBuffer->deviceAddress() + model.geometry.firstVertex * sizeof(glm::vec3),
+            .vertices = chunk.vertexDataBuffer->deviceAddress() + model.geometry.firstVertex * sizeof(VertexData),
+            .vertexCount = deformed.vertexCount,
+            .targetCount = deformed.targetCount,
+            .skinned = deformed.skin >= 0 ? 1u : 0u,
+        });
+        structures.push_back(model.blas.get());
+    }
+    if (dispatches.empty()) {
+        return;
+    }
+
+    if (!skinningPass) {
+        skinningPass = std::make_unique<SkinningPass>(context);
+    }
+    skinningPass->run(context, dispatches, structures);
+    // The refit BLASes have new bounds, the TLAS has to be refit around them even if no instance moved
+    transformsChanged = true;
+}
 
 }  // namespace rendering
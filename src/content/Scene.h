@@ -2,36 +2,88 @@
 
 #include "VulkanContext.h"
 #include "tiny_gltf.h"
+#include "Animation.h"
+#include "Material.h"
 #include "Model.h"
+#include "Skinning.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <deque>
+#include <future>
 #include <glm/mat4x4.hpp>
+#include <optional>
 #include <thread>
+#include <unordered_map>
 
 namespace rendering {
 
+    // Refits in a row after which the TLAS is rebuilt anyway, every refit loosens the bounds of the last build a bit
+    constexpr uint32_t MAX_TLAS_REFITS = 64;
+    /*
+     * Growth of the moved objects' bounds since the last TLAS build, relative to the surface area of every object at
+     * that build, after which the refit hierarchy has loosened enough for a rebuild to pay off
+     */
+    constexpr float TLAS_REBUILD_BOUNDS_GROWTH = 0.25f;
+
+    /*
+     * Files parsed or converted ahead of the one being merged, every parsed file holds its buffers in memory. This
+     * bounds the footprint of scenes made of many files only, a single file is always fully resident until its last
+     * primitive and texture have been converted, so the largest file has to fit in memory on its own.
+     */
+    constexpr size_t MAX_GLTF_FILES_IN_FLIGHT = 2;
+
     struct Object {
         uint32_t modelId;
+        uint32_t materialId;
         uint32_t shaderId;
         glm::mat4 transform;
     };
 
-    struct ObjDesc {
-        glm::mat4 modelMatrix;
+    // Per model record, shared by every object that instances the model
+    struct GeometryDesc {
         uint32_t triangleCount;
-        int32_t baseColorId;
-        int32_t normalId;
-        int32_t metallicRoughnessId;
-        int32_t emissiveId;
-        uint64_t indexAddress;
-        uint64_t positionAddress;
-        uint64_t vertexDataAddress;
+        uint32_t geometryChunk;
+        uint32_t firstIndexWord;
+        uint32_t firstVertex;
+        uint32_t vertexFlags;
+        // vk::IndexType of the model's indices, 16-bit indices are unpacked from 32-bit words in the shaders
+        uint32_t indexType;
+    };
+
+    // Per object record. Geometry stays in object space, the shaders transform positions and directions with these.
+    struct InstanceDesc {
+        glm::mat4 modelMatrix;
+        glm::mat3 normalMatrix;
+        uint32_t geometryId;
+        uint32_t materialId;
+    };
+
+    // One copy of a glTF scene in the world, a sceneId of -1 picks the file's default scene
+    struct GLTFPlacement {
+        int32_t sceneId = 0;
+        glm::mat4 transform = glm::mat4(1.0f);
+        int32_t shaderId = 0;
+    };
+
+    // A file is parsed and converted once, every placement only adds instances of its meshes
+    struct GLTFLoadRequest {
+        std::string path;
+        std::vector<GLTFPlacement> placements = {GLTFPlacement{}};
     };
 
     class Scene {
     public:
         std::unique_ptr<AccelerationStructure> accelerationStructure;
         TextureCache textureCache;
-        std::unique_ptr<Buffer> objDescriptorBuffer;
+        std::unique_ptr<Buffer> instanceDescBuffer;
+        std::unique_ptr<Buffer> geometryDescBuffer;
         std::unique_ptr<Buffer> emissiveObjectIdsBuffer;
+        std::unique_ptr<Buffer> geometryChunkBuffer;
+        std::unique_ptr<Buffer> materialBuffer;
+        std::unique_ptr<TextureStreamer> textureStreamer;
+        GeometryArena geometryArena;
+        std::vector<MaterialDesc> materials;
         std::vector<Object> objects;
         std::vector<std::string> shaderPaths;
         std::vector<uint32_t> emissiveObjectIds;
@@ -43,32 +95,160 @@ namespace rendering {
 
         Scene &operator=(const Scene &) = delete;
 
-        Scene(Scene &&other) noexcept;
+        // Streaming tasks keep pointers into the scene and its mesh cache, so it has to stay where it was created
+        Scene(Scene &&) = delete;
 
         void loadGLTF(rendering::VulkanContext &context, const std::string &path, int32_t sceneId,
                       glm::mat4 transform = glm::mat4(1.0f), int32_t shaderId = 0u);
 
-        void addObject(uint32_t modelId, uint32_t shaderId, const glm::mat4 &transform);
+        // Parses the files and converts their primitives on the pool, then adds the results in request order
+        void loadGLTFs(VulkanContext &context, ThreadPool &pool, const std::vector<GLTFLoadRequest> &requests);
+
+        /*
+         * Queues the files for loading on the pool and returns immediately. The pool has to outlive the stream,
+         * updateStreaming publishes the files as they finish and starts the next ones.
+         */
+        void streamGLTFs(VulkanContext &context, ThreadPool &pool, const std::vector<GLTFLoadRequest> &requests);
+
+        /*
+         * Merges finished files in request order until the budget runs out, then builds their BLASes and rebuilds the
+         * TLAS and the scene buffers. Must be called between frames while the GPU is idle. Returns whether anything
+         * was published, in which case the descriptors pointing at the scene have to be rewritten.
+         */
+        bool updateStreaming(VulkanContext &context, std::chrono::milliseconds budget);
+
+        [[nodiscard]] bool isStreaming() const;
+
+        void addObject(uint32_t modelId, uint32_t materialId, uint32_t shaderId, const glm::mat4 &transform);
 
         uint32_t addModel(Model &model);
 
+        uint32_t addMaterial(const MaterialDesc &material);
+
+        /*
+         * Moves an object. The TLAS instance and the instance descriptor are written through their mappings, so this
+         * may only be called between frames. The TLAS picks the change up in the next updateTransforms.
+         */
+        void setTransform(VulkanContext &context, uint32_t objectId, const glm::mat4 &transform);
+
+        /*
+         * Refits the TLAS to the transforms set since the last call, or rebuilds it once refitting has degraded it too
+         * much. The TLAS is updated in place, so the descriptors pointing at it stay valid. Call between frames.
+         */
+        void updateTransforms(VulkanContext &context);
+
+        /*
+         * Poses the animated glTF files at the time in seconds. Objects on animated nodes are moved with setTransform,
+         * skinned and morphed models are deformed on the GPU and their BLASes refit. Call between frames, before
+         * updateTransforms.
+         */
+        void animate(VulkanContext &context, float time);
+
+        // Builds the BLASes of the models added since the last call and recreates the TLAS and every scene buffer
         void build(VulkanContext &context);
 
     private:
+        struct MeshInstance {
+            uint32_t meshId;
+            glm::mat4 transform;
+            int32_t shaderId;
+            uint32_t nodeId;
+            // Transform of the placement the node belongs to, animated nodes are posed relative to it
+            glm::mat4 placementTransform;
+        };
+
+        // Object whose node is moved by an animation channel
+        struct AnimatedObject {
+            uint32_t objectId;
+            uint32_t animationId;
+            uint32_t nodeId;
+            glm::mat4 placementTransform;
+        };
+
+        // Object with a model of its own, rewritten by the skinning pass whenever its pose changes
+        struct DeformedObject {
+            uint32_t modelId;
+            uint32_t animationId;
+            uint32_t nodeId;
+            // -1 for meshes that are only morphed
+            int32_t skin;
+            uint32_t vertexCount;
+            uint32_t targetCount;
+            // Shared by every instance of the primitive
+            std::shared_ptr<Buffer> restVertices;
+            std::shared_ptr<Buffer> morphDeltas;
+            std::unique_ptr<Buffer> jointMatrices;
+            std::unique_ptr<Buffer> morphWeights;
+        };
+
+        struct GLTFImport {
+            std::string path;
+            std::shared_ptr<const tinygltf::Model> model;
+            // Every node referencing a mesh, in depth-first order
+            std::vector<MeshInstance> instances;
+            std::map<uint32_t, std::vector<std::future<MeshData>>> primitives;
+            // Rest pose and morph targets of the primitives of skinned and morphed meshes
+            std::map<uint32_t, std::vector<std::future<DeformationData>>> deformations;
+            // Copied out while the buffers are still loaded, empty for static files
+            GLTFAnimation animation;
+            std::map<TextureKey, std::future<BakedGLTFTexture>> textures;
+        };
+
+        struct StreamedGLTF {
+            std::future<GLTFImport> plannedImport;
+            // Taken out of plannedImport once the file is parsed, merged when all of its work has finished
+            std::optional<GLTFImport> gltfImport;
+        };
+
         std::vector<Model> models;
         std::unique_ptr<Buffer> instanceBuffer;
-
-        void addNode(
-                VulkanContext &context,
-                const std::string &path,
-                const tinygltf::Model &model,
-                uint32_t nodeId,
-                glm::mat4 parentTransform,
-                std::map<uint32_t, std::vector<uint32_t>> &modelMap,
-                int32_t shaderId,
-                int32_t &count
+        MeshCache meshCache;
+        // Content key of every loaded primitive to its model, shared by all files
+        std::unordered_map<uint64_t, uint32_t> modelIndices;
+        // World space bounds of every object at the last TLAS build and the sum of their surface areas
+        std::vector<Bounds> builtObjectBounds;
+        float builtSurfaceArea = 0.0f;
+        // Objects moved since the last TLAS build, their drift from the built bounds decides when to rebuild it
+        std::vector<bool> movedObjects;
+        std::vector<uint32_t> movedObjectIds;
+        uint32_t tlasRefitCount = 0;
+        bool transformsChanged = false;
+        // One per merged file that has anything to animate
+        std::vector<GLTFAnimation> animations;
+        std::vector<AnimatedObject> animatedObjects;
+        std::vector<DeformedObject> deformedObjects;
+        std::unique_ptr<SkinningPass> skinningPass;
+        std::deque<StreamedGLTF> streamedGLTFs;
+        std::deque<GLTFLoadRequest> queuedRequests;
+        ThreadPool *streamingPool = nullptr;
+        // Models whose BLAS has been built already, build() only handles the ones after these
+        size_t builtModelCount = 0;
+
+        // Parses the file on the pool, then plans its import on the same worker
+        std::future<GLTFImport> submitGLTFImport(ThreadPool &pool,
+                                                 const GLTFLoadRequest &request,
+                                                 bool compressTextures);
+
+        GLTFImport planGLTFImport(
+                ThreadPool &pool,
+                const GLTFLoadRequest &request,
+                std::shared_ptr<tinygltf::Model> model,
+                bool compressTextures
         );
 
+        // Drops the cache entries no file used and reports the totals, once every requested file has been merged
+        void finishLoading();
+
+        // Keeps MAX_GLTF_FILES_IN_FLIGHT streamed files loading
+        void submitQueuedGLTFs(VulkanContext &context);
+
+        void mergeGLTFImport(VulkanContext &context, GLTFImport &gltfImport);
+
+        // Takes the current object bounds as the reference for later refits, after every TLAS build
+        void resetTLASRefits();
+
+        static bool isReady(const GLTFImport &gltfImport);
+
     };
 
 } // rendering
\ No newline at end of file
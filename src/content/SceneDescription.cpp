@@ -0,0 +1,98 @@
+#include "SceneDescription.h"
+
+#include <filesystem>
+#include <fstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "json.hpp"
+
+glm::vec3 getVec3(const nlohmann::json &value, const glm::vec3 &fallback) {
+    if (value.is_null()) {
+        return fallback;
+    }
+    // A single number stands for the same value on every axis, handy for uniform scales
+    if (value.is_number()) {
+        return glm::vec3(value.template get<float>());
+    }
+    const auto components = value.template get<std::vector<float>>();
+    if (components.size() != 3) {
+        throw std::runtime_error("Expected 3 components in scene description, got " + value.dump());
+    }
+    return {components[0], components[1], components[2]};
+}
+
+glm::mat4 getInstanceTransform(const nlohmann::json &instance) {
+    if (instance.contains("matrix")) {
+        const auto elements = instance["matrix"].template get<std::vector<float>>();
+        if (elements.size() != 16) {
+            throw std::runtime_error("Instance matrices need 16 elements, got " + instance["matrix"].dump());
+        }
+        return glm::make_mat4(elements.data());
+    }
+    const auto translation = getVec3(instance.value("translation", nlohmann::json()), glm::vec3(0.0f));
+    const auto rotation = glm::radians(getVec3(instance.value("rotation", nlohmann::json()), glm::vec3(0.0f)));
+    const auto scale = getVec3(instance.value("scale", nlohmann::json()), glm::vec3(1.0f));
+
+    // Scaled first, then rotated around X, Y and Z in this order, then translated
+    auto transform = glm::translate(glm::mat4(1.0f), translation);
+    transform = glm::rotate(transform, rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+    transform = glm::rotate(transform, rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
+    transform = glm::rotate(transform, rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
+    return glm::scale(transform, scale);
+}
+
+namespace rendering {
+
+std::vector<GLTFLoadRequest> loadSceneDescription(const std::string &path) {
+    std::ifstream input(path);
+    if (!input) {
+        throw std::runtime_error("Failed to open scene description " + path);
+    }
+    const auto directory = std::filesystem::path(path).parent_path();
+    std::vector<GLTFLoadRequest> requests;
+
+    if (!path.ends_with(".json")) {
+        for (std::string line; std::getline(input, line);) {
+            if (!line.empty()) {
+                requests.push_back({.path = (directory / line).generic_string()});
+            }
+        }
+        return requests;
+    }
+
+    const auto data = nlohmann::json::parse(input);
+    // Asset name to its request, every asset is parsed once no matter how many times it's placed
+    std::unordered_map<std::string, size_t> assetRequests;
+    for (const auto &asset : data["assets"].template get<std::vector<nlohmann::json>>()) {
+        const auto name = asset["name"].template get<std::string>();
+        if (assetRequests.contains(name)) {
+            throw std::runtime_error("Scene description lists asset " + name + " twice");
+        }
+        assetRequests[name] = requests.size();
+        requests.push_back(GLTFLoadRequest{
+            .path = (directory / asset["path"].template get<std::string>()).generic_string(),
+            .placements = {},
+        });
+    }
+
+    for (const auto &instance : data["instances"].template get<std::vector<nlohmann::json>>()) {
+        const auto name = instance["asset"].template get<std::string>();
+        if (!assetRequests.contains(name)) {
+            throw std::runtime_error("Scene description places unknown asset " + name);
+        }
+        requests[assetRequests.at(name)].placements.push_back(GLTFPlacement{
+            .sceneId = instance.value("scene", 0),
+            .transform = getInstanceTransform(instance),
+            .shaderId = instance.value("shader", 0),
+        });
+    }
+
+    // Assets that are never placed would only cost load time
+    std::erase_if(requests, [](const GLTFLoadRequest &request) { return request.placements.empty(); });
+    return requests;
+}
+
+}  // namespace rendering
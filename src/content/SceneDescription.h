@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Scene.h"
+
+namespace rendering {
+
+    /*
+     * Reads the files to load and where to place them. A .json description lists every asset once and any number of
+     * instances of it:
+     *
+     * {
+     *     "assets": [{"name": "tree", "path": "tree/tree.gltf"}],
+     *     "instances": [{"asset": "tree", "scene": 0, "shader": 1,
+     *                    "translation": [4, 0, 2], "rotation": [0, 90, 0], "scale": 1.5}]
+     * }
+     *
+     * Rotations are XYZ Euler angles in degrees, "matrix" takes a column major 4x4 matrix instead like glTF nodes do.
+     * Any other file is read as the old format, one path per line placed once with the identity transform. Paths are
+     * relative to the description.
+     */
+    std::vector<GLTFLoadRequest> loadSceneDescription(const std::string &path);
+
+}  // namespace rendering
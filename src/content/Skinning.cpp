@@ -0,0 +1,98 @@
+#include "Skinning.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "Trace.h"
+#include "util.h"
+
+namespace rendering {
+
+SkinningPass::SkinningPass(VulkanContext &context) {
+    const vk::PushConstantRange pushConstantRange{vk::ShaderStageFlagBits::eCompute, 0, sizeof(SkinningDispatch)};
+    // Everything is reached through device addresses, the layout has no descriptor sets
+    vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.setPushConstantRanges(pushConstantRange);
+    pipelineLayout = context.device->createPipelineLayoutUnique(pipelineLayoutCreateInfo);
+
+    const auto shaderModule = createShader(context, SKINNING_SHADER_PATH);
+    const vk::PipelineShaderStageCreateInfo shaderStageCreateInfo{
+        {},
+        vk::ShaderStageFlagBits::eCompute,
+        *shaderModule,
+        "main",
+    };
+    const vk::ComputePipelineCreateInfo pipelineCreateInfo{
+        {},
+        shaderStageCreateInfo,
+        *pipelineLayout,
+    };
+    pipeline = context.device->createComputePipelineUnique(nullptr, pipelineCreateInfo).value;
+
+    const auto properties = context.physicalDevice.getProperties2<
+        vk::PhysicalDeviceProperties2,
+        vk::PhysicalDeviceAccelerationStructurePropertiesKHR>();
+    scratchAlignment = std::max<uint64_t>(
+        properties.get<vk::PhysicalDeviceAccelerationStructurePropertiesKHR>().minAccelerationStructureScratchOffsetAlignment,
+        128);
+}
+
+void SkinningPass::run(VulkanContext &context,
+                       std::span<const SkinningDispatch> dispatches,
+                       std::span<AccelerationStructure *const> structures) {
+    TRACE_SCOPE("Skin and refit");
+    if (dispatches.empty()) {
+        return;
+    }
+
+    std::vector<uint64_t> scratchOffsets(structures.size());
+    uint64_t requiredScratchSize = 0;
+    for (size_t i = 0; i < structures.size(); i++) {
+        scratchOffsets[i] = requiredScratchSize;
+        requiredScratchSize += alignUp(structures[i]->updateScratchBufferSize, scratchAlignment);
+    }
+    if (requiredScratchSize > scratchBufferSize) {
+        scratchBufferSize = requiredScratchSize;
+        scratchBuffer = std::make_unique<Buffer>(
+            context,
+            scratchBufferSize + scratchAlignment,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+    }
+
+    std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> updateInfos;
+    std::vector<const vk::AccelerationStructureBuildRangeInfoKHR *> rangeInfos;
+    if (!structures.empty()) {
+        const auto scratchBase = alignUp(scratchBuffer->deviceAddress(), scratchAlignment);
+        for (size_t i = 0; i < structures.size(); i++) {
+            updateInfos.push_back(structures[i]->getUpdateInfo(scratchBase + scratchOffsets[i]));
+            rangeInfos.push_back(&structures[i]->buildRangeInfo);
+        }
+    }
+
+    context.createAndSubmitCommandBuffer([&](vk::CommandBuffer cmd) {
+        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
+        for (const auto &dispatch : dispatches) {
+            cmd.pushConstants(*pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(SkinningDispatch), &dispatch);
+            cmd.dispatch((dispatch.vertexCount + SKINNING_GROUP_SIZE - 1) / SKINNING_GROUP_SIZE, 1, 1);
+        }
+
+        // The refits read the positions the dispatches wrote, the ray tracing passes read both
+        const vk::MemoryBarrier barrier{
+            vk::AccessFlagBits::eShaderWrite,
+            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eAccelerationStructureReadKHR,
+        };
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                            vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR |
+                                vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                            {},
+                            barrier,
+                            {},
+                            {});
+        if (!updateInfos.empty()) {
+            cmd.buildAccelerationStructuresKHR(
+                static_cast<uint32_t>(updateInfos.size()), updateInfos.data(), rangeInfos.data());
+        }
+    });
+}
+
+}  // namespace rendering
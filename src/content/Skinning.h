@@ -0,0 +1,54 @@
+#pragma once
+
+#include "VulkanContext.h"
+
+#include <memory>
+#include <span>
+#include <string>
+#include <vulkan/vulkan.hpp>
+
+#include "AccelerationStructure.h"
+#include "Buffer.h"
+
+namespace rendering {
+
+    constexpr auto SKINNING_SHADER_PATH = "shaders-spv/compute/skinning.comp.spv";
+    constexpr uint32_t SKINNING_GROUP_SIZE = 64;
+
+    // Push constants of shaders/compute/skinning.comp, one dispatch deforms one model
+    struct SkinningDispatch {
+        vk::DeviceAddress restVertices;
+        vk::DeviceAddress morphDeltas;
+        vk::DeviceAddress jointMatrices;
+        vk::DeviceAddress morphWeights;
+        // The model's first position and vertex in its geometry chunk
+        vk::DeviceAddress positions;
+        vk::DeviceAddress vertices;
+        uint32_t vertexCount;
+        uint32_t targetCount;
+        uint32_t skinned;
+    };
+
+    /*
+     * Morphs and skins models on the GPU, writing the results over their geometry in the arena, then refits their
+     * BLASes in the same submission.
+     */
+    class SkinningPass {
+    public:
+        explicit SkinningPass(VulkanContext &context);
+
+        // The structures have to be the BLASes of the deformed models, created with eAllowUpdate
+        void run(VulkanContext &context,
+                 std::span<const SkinningDispatch> dispatches,
+                 std::span<AccelerationStructure *const> structures);
+
+    private:
+        vk::UniquePipelineLayout pipelineLayout;
+        vk::UniquePipeline pipeline;
+        uint64_t scratchAlignment;
+        // Shared by every refit of a run, grows to fit the largest one
+        std::unique_ptr<Buffer> scratchBuffer;
+        uint64_t scratchBufferSize = 0;
+    };
+
+}  // namespace rendering
@@ -0,0 +1,479 @@
+#include "TextureBaker.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include "Hash.h"
+#include "MeshCache.h"
+#include "Trace.h"
+
+namespace rendering {
+
+namespace {
+
+constexpr uint32_t BLOCK_DIMENSION = 4;
+constexpr uint32_t BLOCK_TEXELS = BLOCK_DIMENSION * BLOCK_DIMENSION;
+
+// Interpolation weights of BC7's 4-bit indices, out of 64
+constexpr std::array<uint32_t, 16> BC7_WEIGHTS = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+using Texel = std::array<uint8_t, 4>;
+using Block = std::array<Texel, BLOCK_TEXELS>;
+
+uint32_t getMipExtent(uint32_t extent, uint32_t level) {
+    return std::max(extent >> level, 1u);
+}
+
+uint64_t getLevelSize(TextureFormat format, uint32_t width, uint32_t height) {
+    const uint64_t blockCount = static_cast<uint64_t>((width + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION) *
+                                ((height + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION);
+    switch (format) {
+        case TextureFormat::RGBA8:
+            return static_cast<uint64_t>(width) * height * 4;
+        case TextureFormat::BC4:
+            return blockCount * 8;
+        case TextureFormat::BC5:
+        case TextureFormat::BC7:
+            return blockCount * 16;
+    }
+    throw std::runtime_error("Unhandled texture format");
+}
+
+bool isGrayscale(std::span<const uint8_t> pixels) {
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        if (pixels[i] != pixels[i + 1] || pixels[i] != pixels[i + 2] || pixels[i + 3] != 255) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 2x2 box filter, the last row and column are repeated for odd sizes
+std::vector<uint8_t> downsample(std::span<const uint8_t> pixels, uint32_t width, uint32_t height) {
+    const auto targetWidth = std::max(width / 2, 1u);
+    const auto targetHeight = std::max(height / 2, 1u);
+    std::vector<uint8_t> result(static_cast<size_t>(targetWidth) * targetHeight * 4);
+    for (uint32_t y = 0; y < targetHeight; y++) {
+        const auto y0 = std::min(y * 2, height - 1);
+        const auto y1 = std::min(y * 2 + 1, height - 1);
+        for (uint32_t x = 0; x < targetWidth; x++) {
+            const auto x0 = std::min(x * 2, width - 1);
+            const auto x1 = std::min(x * 2 + 1, width - 1);
+            for (uint32_t channel = 0; channel < 4; channel++) {
+                const auto texel = [&](uint32_t tx, uint32_t ty) -> uint32_t {
+                    return pixels[(static_cast<size_t>(ty) * width + tx) * 4 + channel];
+                };
+                const auto sum = texel(x0, y0) + texel(x1, y0) + texel(x0, y1) + texel(x1, y1);
+                result[(static_cast<size_t>(y) * targetWidth + x) * 4 + channel] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+// Texels past the edge of the image repeat the last row and column
+Block loadBlock(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY) {
+    Block block;
+    for (uint32_t y = 0; y < BLOCK_DIMENSION; y++) {
+        const auto sourceY = std::min(blockY * BLOCK_DIMENSION + y, height - 1);
+        for (uint32_t x = 0; x < BLOCK_DIMENSION; x++) {
+            const auto sourceX = std::min(blockX * BLOCK_DIMENSION + x, width - 1);
+            std::memcpy(block[y * BLOCK_DIMENSION + x].data(),
+                        pixels.data() + (static_cast<size_t>(sourceY) * width + sourceX) * 4,
+                        4);
+        }
+    }
+    return block;
+}
+
+std::array<uint8_t, BLOCK_TEXELS> getChannel(const Block &block, uint32_t channel) {
+    std::array<uint8_t, BLOCK_TEXELS> values;
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+        values[i] = block[i][channel];
+    }
+    return values;
+}
+
+// Packs fields LSB first into a 128-bit block
+class BitWriter {
+public:
+    void write(uint32_t value, uint32_t bitCount) {
+        for (uint32_t i = 0; i < bitCount; i++) {
+            if ((value >> i) & 1u) {
+                words[position / 64] |= 1ull << (position % 64);
+            }
+            position++;
+        }
+    }
+
+    void store(uint8_t *destination) const {
+        std::memcpy(destination, words, sizeof(words));
+    }
+
+private:
+    uint64_t words[2] = {};
+    uint32_t position = 0;
+};
+
+// Endpoints at the extremes of the block with all 8 interpolated values, indices are rounded along the ramp
+void encodeBC4(const std::array<uint8_t, BLOCK_TEXELS> &values, uint8_t *destination) {
+    const auto [lowIt, highIt] = std::minmax_element(values.begin(), values.end());
+    const uint32_t low = *lowIt;
+    const uint32_t high = *highIt;
+    destination[0] = static_cast<uint8_t>(high);
+    destination[1] = static_cast<uint8_t>(low);
+
+    uint64_t indices = 0;
+    if (high > low) {
+        const auto range = high - low;
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+            // Position on the ramp from low (0) to high (7). Index 0 is the high endpoint, 1 the low one and the rest
+            // go from high to low in between.
+            const auto step = ((values[i] - low) * 14 + range) / (2 * range);
+            const auto index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+            indices |= static_cast<uint64_t>(index) << (3 * i);
+        }
+    }
+    for (uint32_t i = 0; i < 6; i++) {
+        destination[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+    }
+}
+
+struct BC7Endpoint {
+    std::array<uint32_t, 4> values;  // 7 bits per channel
+    uint32_t pBit;
+
+    [[nodiscard]] uint32_t expand(uint32_t channel) const {
+        return values[channel] << 1 | pBit;
+    }
+};
+
+BC7Endpoint quantizeBC7Endpoint(const std::array<float, 4> &color) {
+    BC7Endpoint best{};
+    auto bestError = std::numeric_limits<float>::max();
+    for (uint32_t pBit = 0; pBit < 2; pBit++) {
+        BC7Endpoint endpoint{{}, pBit};
+        auto error = 0.0f;
+        for (uint32_t channel = 0; channel < 4; channel++) {
+            const auto value = std::clamp(color[channel], 0.0f, 255.0f);
+            endpoint.values[channel] =
+                static_cast<uint32_t>(std::clamp(std::lround((value - static_cast<float>(pBit)) / 2.0f), 0l, 127l));
+            const auto difference = static_cast<float>(endpoint.expand(channel)) - value;
+            error += difference * difference;
+        }
+        if (error < bestError) {
+            bestError = error;
+            best = endpoint;
+        }
+    }
+    return best;
+}
+
+/*
+ * Mode 6 only: a single RGBA line with 7-bit endpoints, a p-bit per endpoint and 4-bit indices. The line is fitted
+ * to the principal axis of the block's texels, found by power iteration on their covariance.
+ */
+void encodeBC7(const Block &block, uint8_t *destination) {
+    std::array<float, 4> mean{};
+    std::array<float, 4> low;
+    std::array<float, 4> high;
+    low.fill(255.0f);
+    high.fill(0.0f);
+    for (const auto &texel : block) {
+        for (uint32_t channel = 0; channel < 4; channel++) {
+            const auto value = static_cast<float>(texel[channel]);
+            mean[channel] += value / BLOCK_TEXELS;
+            low[channel] = std::min(low[channel], value);
+            high[channel] = std::max(high[channel], value);
+        }
+    }
+
+    float covariance[4][4] = {};
+    for (const auto &texel : block) {
+        for (uint32_t i = 0; i < 4; i++) {
+            for (uint32_t j = 0; j < 4; j++) {
+                covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+            }
+        }
+    }
+
+    std::array<float, 4> axis;
+    for (uint32_t channel = 0; channel < 4; channel++) {
+        axis[channel] = high[channel] - low[channel];
+    }
+    for (uint32_t iteration = 0; iteration < 8; iteration++) {
+        std::array<float, 4> next{};
+        for (uint32_t i = 0; i < 4; i++) {
+            for (uint32_t j = 0; j < 4; j++) {
+                next[i] += covariance[i][j] * axis[j];
+            }
+        }
+        const auto length = std::max({std::abs(next[0]), std::abs(next[1]), std::abs(next[2]), std::abs(next[3])});
+        if (length < 1e-6f) {
+            break;
+        }
+        for (uint32_t channel = 0; channel < 4; channel++) {
+            axis[channel] = next[channel] / length;
+        }
+    }
+
+    const auto axisLengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+    auto minT = 0.0f;
+    auto maxT = 0.0f;
+    if (axisLengthSquared > 1e-6f) {
+        minT = std::numeric_limits<float>::max();
+        maxT = std::numeric_limits<float>::lowest();
+        for (const auto &texel : block) {
+            auto t = 0.0f;
+            for (uint32_t channel = 0; channel < 4; channel++) {
+                t += (texel[channel] - mean[channel]) * axis[channel];
+            }
+            t /= axisLengthSquared;
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+    }
+    std::array<float, 4> start;
+    std::array<float, 4> end;
+    for (uint32_t channel = 0; channel < 4; channel++) {
+        start[channel] = mean[channel] + axis[channel] * minT;
+        end[channel] = mean[channel] + axis[channel] * maxT;
+    }
+    auto endpoint0 = quantizeBC7Endpoint(start);
+    auto endpoint1 = quantizeBC7Endpoint(end);
+
+    std::array<std::array<uint32_t, 4>, 16> palette;
+    for (uint32_t i = 0; i < 16; i++) {
+        for (uint32_t channel = 0; channel < 4; channel++) {
+            palette[i][channel] =
+                ((64 - BC7_WEIGHTS[i]) * endpoint0.expand(channel) + BC7_WEIGHTS[i] * endpoint1.expand(channel) + 32) >>
+                6;
+        }
+    }
+
+    std::array<uint32_t, BLOCK_TEXELS> indices;
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+        auto bestError = std::numeric_limits<uint32_t>::max();
+        for (uint32_t candidate = 0; candidate < 16; candidate++) {
+            uint32_t error = 0;
+            for (uint32_t channel = 0; channel < 4; channel++) {
+                const auto difference = static_cast<int32_t>(palette[candidate][channel]) - block[i][channel];
+                error += static_cast<uint32_t>(difference * difference);
+            }
+            if (error < bestError) {
+                bestError = error;
+                indices[i] = candidate;
+            }
+        }
+    }
+
+    // The first index is stored without its top bit, swapping the endpoints mirrors the indices to make it zero
+    if (indices[0] >= 8) {
+        std::swap(endpoint0, endpoint1);
+        for (auto &index : indices) {
+            index = 15 - index;
+        }
+    }
+
+    BitWriter writer;
+    writer.write(1u << 6, 7);
+    for (uint32_t channel = 0; channel < 4; channel++) {
+        writer.write(endpoint0.values[channel], 7);
+        writer.write(endpoint1.values[channel], 7);
+    }
+    writer.write(endpoint0.pBit, 1);
+    writer.write(endpoint1.pBit, 1);
+    writer.write(indices[0], 3);
+    for (uint32_t i = 1; i < BLOCK_TEXELS; i++) {
+        writer.write(indices[i], 4);
+    }
+    writer.store(destination);
+}
+
+void encodeLevel(std::span<const uint8_t> pixels,
+                 uint32_t width,
+                 uint32_t height,
+                 TextureFormat format,
+                 TextureSwizzle swizzle,
+                 uint8_t *destination) {
+    if (format == TextureFormat::RGBA8) {
+        std::memcpy(destination, pixels.data(), static_cast<size_t>(width) * height * 4);
+        return;
+    }
+
+    const auto blocksX = (width + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION;
+    const auto blocksY = (height + BLOCK_DIMENSION - 1) / BLOCK_DIMENSION;
+    const auto blockSize = format == TextureFormat::BC4 ? 8 : 16;
+    // Metallic-roughness textures keep roughness in G and metalness in B, the other formats start from R
+    const auto firstChannel = swizzle == TextureSwizzle::MetallicRoughness ? 1u : 0u;
+    for (uint32_t blockY = 0; blockY < blocksY; blockY++) {
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++) {
+            const auto block = loadBlock(pixels, width, height, blockX, blockY);
+            auto *output = destination + (static_cast<size_t>(blockY) * blocksX + blockX) * blockSize;
+            switch (format) {
+                case TextureFormat::BC7:
+                    encodeBC7(block, output);
+                    break;
+                case TextureFormat::BC5:
+                    encodeBC4(getChannel(block, firstChannel), output);
+                    encodeBC4(getChannel(block, firstChannel + 1), output + 8);
+                    break;
+                case TextureFormat::BC4:
+                    encodeBC4(getChannel(block, firstChannel), output);
+                    break;
+                case TextureFormat::RGBA8:
+                    break;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+uint64_t getTextureBakeKey(
+    std::span<const uint8_t> pixels, uint32_t width, uint32_t height, TextureKind kind, bool compress) {
+    const auto pixelHash = hashBytes(pixels.data(), pixels.size(), TEXTURE_CACHE_VERSION);
+    const uint32_t parameters[] = {width, height, static_cast<uint32_t>(kind), compress ? 1u : 0u};
+    return hashBytes(parameters, sizeof(parameters), pixelHash);
+}
+
+BakedTexture bakeTexture(
+    std::span<const uint8_t> pixels, uint32_t width, uint32_t height, TextureKind kind, bool compress) {
+    TRACE_SCOPE("Bake texture");
+    if (width == 0 || height == 0 || pixels.size() < static_cast<size_t>(width) * height * 4) {
+        throw std::runtime_error("Texture data doesn't match its size, only 8-bit RGBA textures are supported");
+    }
+    const auto mipLevels = static_cast<uint32_t>(std::bit_width(std::max(width, height)));
+    if (mipLevels > MAX_TEXTURE_MIP_LEVELS) {
+        throw std::runtime_error("Texture is too large");
+    }
+
+    auto format = TextureFormat::RGBA8;
+    auto swizzle = TextureSwizzle::Identity;
+    if (compress) {
+        switch (kind) {
+            case TextureKind::Color:
+            case TextureKind::Emissive:
+                if (isGrayscale(pixels)) {
+                    format = TextureFormat::BC4;
+                    swizzle = TextureSwizzle::Grayscale;
+                } else {
+                    format = TextureFormat::BC7;
+                }
+                break;
+            case TextureKind::Normal:
+                // Z is reconstructed in the shader
+                format = TextureFormat::BC5;
+                break;
+            case TextureKind::MetallicRoughness:
+                format = TextureFormat::BC5;
+                swizzle = TextureSwizzle::MetallicRoughness;
+                break;
+        }
+    }
+
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> levelOffsets;
+    std::vector<uint8_t> downsampled;
+    auto level = pixels.first(static_cast<size_t>(width) * height * 4);
+    for (uint32_t i = 0; i < mipLevels; i++) {
+        const auto levelWidth = getMipExtent(width, i);
+        const auto levelHeight = getMipExtent(height, i);
+        const auto offset = (data.size() + TEXTURE_LEVEL_ALIGNMENT - 1) / TEXTURE_LEVEL_ALIGNMENT *
+                            TEXTURE_LEVEL_ALIGNMENT;
+        data.resize(offset + getLevelSize(format, levelWidth, levelHeight));
+        levelOffsets.push_back(offset);
+        encodeLevel(level, levelWidth, levelHeight, format, swizzle, data.data() + offset);
+
+        if (i + 1 < mipLevels) {
+            auto next = downsample(level, levelWidth, levelHeight);
+            downsampled = std::move(next);
+            level = downsampled;
+        }
+    }
+    return {format, swizzle, width, height, std::move(data), std::move(levelOffsets)};
+}
+
+std::optional<BakedTexture> readTextureCache(const std::filesystem::path &path) {
+    TRACE_SCOPE("Read texture cache");
+    auto file = MappedFile::open(path);
+    if (!file || file->size() < sizeof(TextureCacheHeader)) {
+        return std::nullopt;
+    }
+
+    TextureCacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(TextureCacheHeader));
+    if (header.magic != TEXTURE_CACHE_MAGIC || header.version != TEXTURE_CACHE_VERSION) {
+        return std::nullopt;
+    }
+
+    const auto payloadSize = file->size() - sizeof(TextureCacheHeader);
+    auto valid = header.fileSize == file->size() && header.format <= TextureFormat::BC4 &&
+                 header.swizzle <= TextureSwizzle::MetallicRoughness && header.width > 0 && header.height > 0 &&
+                 header.mipLevels > 0 && header.mipLevels <= MAX_TEXTURE_MIP_LEVELS;
+    for (uint32_t i = 0; valid && i < header.mipLevels; i++) {
+        const auto offset = header.levelOffsets[i];
+        const auto size =
+            getLevelSize(header.format, getMipExtent(header.width, i), getMipExtent(header.height, i));
+        valid = offset % TEXTURE_LEVEL_ALIGNMENT == 0 && offset <= payloadSize && size <= payloadSize - offset;
+    }
+    if (!valid) {
+        std::cout << "Ignoring malformed texture cache file " << path << "\n";
+        return std::nullopt;
+    }
+    const auto *payload = file->data() + sizeof(TextureCacheHeader);
+    if (hashBytes(payload, payloadSize, TEXTURE_CACHE_VERSION) != header.payloadHash) {
+        std::cout << "Ignoring corrupt texture cache file " << path << "\n";
+        return std::nullopt;
+    }
+
+    std::vector<uint64_t> levelOffsets(header.levelOffsets, header.levelOffsets + header.mipLevels);
+    const std::span<const uint8_t> data(payload, payloadSize);
+    return BakedTexture(
+        std::move(file), header.format, header.swizzle, header.width, header.height, data, std::move(levelOffsets));
+}
+
+void writeTextureCache(const std::filesystem::path &path, const BakedTexture &texture) {
+    TRACE_SCOPE("Write texture cache");
+    TextureCacheHeader header{
+        .magic = TEXTURE_CACHE_MAGIC,
+        .version = TEXTURE_CACHE_VERSION,
+        .fileSize = sizeof(TextureCacheHeader) + texture.data.size(),
+        .payloadHash = hashBytes(texture.data.data(), texture.data.size(), TEXTURE_CACHE_VERSION),
+        .format = texture.format,
+        .swizzle = texture.swizzle,
+        .width = texture.width,
+        .height = texture.height,
+        .mipLevels = texture.mipLevels(),
+    };
+    std::copy(texture.levelOffsets.begin(), texture.levelOffsets.end(), header.levelOffsets);
+
+    // Written under a temporary name and renamed, so readers never see a partially written file
+    std::filesystem::create_directories(path.parent_path());
+    const auto temporaryPath = getTemporaryPath(path);
+    {
+        std::ofstream cacheFile(temporaryPath, std::ios::binary | std::ios::trunc);
+        cacheFile.write(reinterpret_cast<const char *>(&header), sizeof(TextureCacheHeader));
+        cacheFile.write(reinterpret_cast<const char *>(texture.data.data()),
+                        static_cast<std::streamsize>(texture.data.size()));
+        if (!cacheFile) {
+            std::cout << "Failed to write texture cache file " << path << "\n";
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::cout << "Failed to write texture cache file " << path << ": " << error.message() << "\n";
+        std::filesystem::remove(temporaryPath, error);
+    }
+}
+
+}  // namespace rendering
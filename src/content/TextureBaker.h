@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "MappedFile.h"
+
+namespace rendering {
+
+    constexpr uint32_t TEXTURE_CACHE_MAGIC = 0x54435452;  // "RTCT"
+    constexpr uint32_t TEXTURE_CACHE_VERSION = 1;
+    constexpr auto TEXTURE_CACHE_EXTENSION = ".texture";
+    constexpr uint32_t MAX_TEXTURE_MIP_LEVELS = 16;
+    constexpr uint64_t TEXTURE_LEVEL_ALIGNMENT = 16;
+
+    // How a texture is used by the materials, decides which format it gets baked to
+    enum class TextureKind : uint32_t {
+        Color,
+        Normal,
+        MetallicRoughness,
+        Emissive,
+    };
+
+    enum class TextureFormat : uint32_t {
+        RGBA8,
+        BC7,  // RGBA, used for color textures
+        BC5,  // Two independent channels, normal XY or roughness and metalness
+        BC4,  // Single channel, used for grayscale color textures
+    };
+
+    // Swizzle applied by the image view, so shaders find every channel where the glTF layout puts it
+    enum class TextureSwizzle : uint32_t {
+        Identity,
+        Grayscale,          // R is replicated to RGB, alpha is one
+        MetallicRoughness,  // R holds roughness and is read from G, G holds metalness and is read from B
+    };
+
+    /*
+     * Layout of a baked texture file: this header, then every mip level at a 16 byte aligned offset. The offsets are
+     * relative to the end of the header and the payload hash covers everything after it.
+     */
+    struct TextureCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t fileSize;
+        uint64_t payloadHash;
+        TextureFormat format;
+        TextureSwizzle swizzle;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipLevels;
+        uint32_t padding;
+        uint64_t levelOffsets[MAX_TEXTURE_MIP_LEVELS];
+    };
+
+    /*
+     * Full mip chain of a texture in its final GPU format. Like MeshData, the data either lives in this object or in a
+     * memory mapped cache file.
+     */
+    class BakedTexture {
+    public:
+        TextureFormat format = TextureFormat::RGBA8;
+        TextureSwizzle swizzle = TextureSwizzle::Identity;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::span<const uint8_t> data;
+        // Start of every mip level inside data
+        std::vector<uint64_t> levelOffsets;
+
+        BakedTexture() = default;
+
+        BakedTexture(TextureFormat format,
+                     TextureSwizzle swizzle,
+                     uint32_t width,
+                     uint32_t height,
+                     std::vector<uint8_t> data,
+                     std::vector<uint64_t> levelOffsets)
+                : format(format),
+                  swizzle(swizzle),
+                  width(width),
+                  height(height),
+                  levelOffsets(std::move(levelOffsets)),
+                  storage(std::move(data)) {
+            this->data = storage;
+        }
+
+        BakedTexture(std::unique_ptr<MappedFile> mapping,
+                     TextureFormat format,
+                     TextureSwizzle swizzle,
+                     uint32_t width,
+                     uint32_t height,
+                     std::span<const uint8_t> data,
+                     std::vector<uint64_t> levelOffsets)
+                : format(format),
+                  swizzle(swizzle),
+                  width(width),
+                  height(height),
+                  data(data),
+                  levelOffsets(std::move(levelOffsets)),
+                  mapping(std::move(mapping)) {
+        }
+
+        BakedTexture(const BakedTexture &) = delete;
+
+        BakedTexture &operator=(const BakedTexture &) = delete;
+
+        BakedTexture(BakedTexture &&other) noexcept = default;
+
+        BakedTexture &operator=(BakedTexture &&other) noexcept = default;
+
+        [[nodiscard]] uint32_t mipLevels() const {
+            return static_cast<uint32_t>(levelOffsets.size());
+        }
+
+        // Bytes taken by the levels from firstLevel to the end of the chain
+        [[nodiscard]] uint64_t levelsSize(uint32_t firstLevel) const {
+            return data.size() - levelOffsets[firstLevel];
+        }
+
+    private:
+        std::vector<uint8_t> storage;
+        std::unique_ptr<MappedFile> mapping;
+    };
+
+    /*
+     * Covers the source bytes and every bake parameter, used as the cache file name. The source is either tightly
+     * packed texels or an encoded image, which carries its own size and is passed with a zero width and height.
+     */
+    uint64_t getTextureBakeKey(
+        std::span<const uint8_t> pixels, uint32_t width, uint32_t height, TextureKind kind, bool compress);
+
+    /*
+     * Builds the mip chain of tightly packed RGBA8 texels with a box filter and encodes every level. Without compress
+     * the levels are kept as RGBA8, for devices that can't sample BC formats.
+     */
+    BakedTexture bakeTexture(
+        std::span<const uint8_t> pixels, uint32_t width, uint32_t height, TextureKind kind, bool compress);
+
+    // Maps the file and returns spans into the mapping, or nothing if it's missing, outdated or corrupt
+    std::optional<BakedTexture> readTextureCache(const std::filesystem::path &path);
+
+    void writeTextureCache(const std::filesystem::path &path, const BakedTexture &texture);
+
+}  // namespace rendering
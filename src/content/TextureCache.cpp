@@ -1,43 +1,168 @@
 #include "TextureCache.h"
 
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+#include "Trace.h"
+#include "stb_image.h"
+
 namespace rendering {
+
+namespace {
+
+struct DecodedImage {
+    std::vector<uint8_t> pixels;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Encoded images are keyed by their bytes, so a cached bake can be found without decoding them
+uint64_t getGLTFTextureKey(const tinygltf::Image &image, TextureKind kind, bool compress) {
+    if (image.as_is) {
+        return getTextureBakeKey(image.image, 0, 0, kind, compress);
+    }
+    return getTextureBakeKey(
+        image.image, static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height), kind, compress);
+}
+
+DecodedImage decodeGLTFImage(const tinygltf::Image &image) {
+    TRACE_SCOPE("Decode image");
+    if (!image.as_is) {
+        return {image.image, static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height)};
+    }
+    int width, height, components;
+    auto *pixels = stbi_load_from_memory(
+        image.image.data(), static_cast<int>(image.image.size()), &width, &height, &components, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("Failed to decode image " + image.name + ": " + stbi_failure_reason());
+    }
+    DecodedImage decoded{
+        std::vector<uint8_t>(pixels, pixels + static_cast<size_t>(width) * height * 4),
+        static_cast<uint32_t>(width),
+        static_cast<uint32_t>(height),
+    };
+    stbi_image_free(pixels);
+    return decoded;
+}
+
+}  // namespace
+
+std::vector<TextureKey> getMaterialTextures(const tinygltf::Model &model) {
+    std::vector<TextureKey> keys;
+    const auto addTexture = [&](int32_t textureIndex, TextureKind kind) {
+        const TextureKey key{textureIndex, kind};
+        if (textureIndex >= 0 && std::find(keys.begin(), keys.end(), key) == keys.end()) {
+            keys.push_back(key);
+        }
+    };
+    for (const auto &material : model.materials) {
+        addTexture(material.pbrMetallicRoughness.baseColorTexture.index, TextureKind::Color);
+        addTexture(material.normalTexture.index, TextureKind::Normal);
+        addTexture(material.pbrMetallicRoughness.metallicRoughnessTexture.index, TextureKind::MetallicRoughness);
+        addTexture(material.emissiveTexture.index, TextureKind::Emissive);
+    }
+    return keys;
+}
+
+bool storeEncodedGLTFImage(tinygltf::Image *image,
+                           int imageIndex,
+                           std::string *err,
+                           std::string *warn,
+                           int requestedWidth,
+                           int requestedHeight,
+                           const unsigned char *bytes,
+                           int size,
+                           void *userData) {
+    if (size <= 0) {
+        if (err) {
+            *err += "Image " + std::to_string(imageIndex) + " is empty\n";
+        }
+        return false;
+    }
+    image->image.assign(bytes, bytes + size);
+    image->as_is = true;
+    return true;
+}
+
+BakedGLTFTexture TextureCache::bakeGLTFTexture(MeshCache &meshCache,
+                                               const std::string &modelPath,
+                                               const tinygltf::Model &model,
+                                               TextureKey key,
+                                               bool compress) {
+    TRACE_SCOPE("Load texture");
+    const auto &imageData = model.images[model.textures[key.first].source];
+    const auto contentKey = getGLTFTextureKey(imageData, key.second, compress);
+    const auto cacheFilePath = meshCache.getPath(
+        (std::filesystem::path(modelPath) / "textures").string(), contentKey, TEXTURE_CACHE_EXTENSION);
+    if (auto cached = readTextureCache(cacheFilePath)) {
+        return {contentKey, std::move(*cached)};
+    }
+
+    const auto decoded = decodeGLTFImage(imageData);
+    auto texture = bakeTexture(decoded.pixels, decoded.width, decoded.height, key.second, compress);
+    writeTextureCache(cacheFilePath, texture);
+    // The texture is kept for streaming, a mapping of the file doesn't hold on to the memory
+    if (auto cached = readTextureCache(cacheFilePath)) {
+        return {contentKey, std::move(*cached)};
+    }
+    return {contentKey, std::move(texture)};
+}
+
 int32_t TextureCache::loadImage(VulkanContext &context,
                                 const tinygltf::Model &model,
                                 int32_t textureIndex,
-                                vk::Format format) {
-    if (loadedTextureIndices.contains(textureIndex)) {
-        return loadedTextureIndices.at(textureIndex);
-    }
-
-    const auto textureData = model.textures[textureIndex];
-    const auto imageData = model.images[textureData.source];
-    const auto index = static_cast<int32_t>(images.size());
-    images.push_back(std::make_unique<Image>(context,
-                                             vk::Extent2D{
-                                                 static_cast<uint32_t>(imageData.width),
-                                                 static_cast<uint32_t>(imageData.height),
-                                             },
-                                             format,
-                                             imageData.image.data()));
-    loadedTextureIndices[textureIndex] = index;
+                                TextureKind kind) {
+    const TextureKey key{textureIndex, kind};
+    if (loadedTextureIndices.contains(key)) {
+        return loadedTextureIndices.at(key);
+    }
+
+    BakedGLTFTexture baked;
+    if (const auto pending = pendingTextures.find(key); pending != pendingTextures.end()) {
+        baked = pending->second.get();
+        pendingTextures.erase(pending);
+    } else {
+        // Not scheduled by the import, bake it here without going through the cache
+        const auto &imageData = model.images[model.textures[textureIndex].source];
+        baked.contentKey = getGLTFTextureKey(imageData, kind, context.textureCompressionBC);
+        if (!contentIndices.contains(baked.contentKey)) {
+            const auto decoded = decodeGLTFImage(imageData);
+            baked.texture =
+                bakeTexture(decoded.pixels, decoded.width, decoded.height, kind, context.textureCompressionBC);
+        }
+    }
+
+    auto index = -1;
+    if (const auto existing = contentIndices.find(baked.contentKey); existing != contentIndices.end()) {
+        index = existing->second;
+    } else {
+        if (images.size() >= MAX_SCENE_TEXTURES) {
+            throw std::runtime_error(std::format("{} doesn't fit in the scene, it would have more than {} textures",
+                                                 currentModelPath,
+                                                 MAX_SCENE_TEXTURES));
+        }
+        index = static_cast<int32_t>(images.size());
+        auto level = 0u;
+        while (level + 1 < baked.texture.mipLevels() &&
+               std::max(baked.texture.width, baked.texture.height) >> level > INITIAL_RESIDENT_TEXTURE_SIZE) {
+            level++;
+        }
+        images.push_back(std::make_unique<Image>(context, baked.texture, level));
+        sources.push_back(std::move(baked.texture));
+        residentLevels.push_back(level);
+        contentIndices[baked.contentKey] = index;
+    }
+    loadedTextureIndices[key] = index;
     return index;
 }
 
-void TextureCache::nextModel() {
+void TextureCache::nextModel(const std::string &modelPath,
+                             std::map<TextureKey, std::future<BakedGLTFTexture>> bakedTextures) {
+    // Texture indices are only meaningful within a file, content keys stay valid for the whole scene
+    currentModelPath = modelPath;
     loadedTextureIndices.clear();
+    pendingTextures = std::move(bakedTextures);
 }
 
-int32_t TextureCache::create1x1Texture(
-    VulkanContext &context, uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha, vk::Format format) {
-    const auto index = static_cast<int32_t>(images.size());
-    uint8_t color[] = {red, green, blue, alpha};
-    images.push_back(std::make_unique<Image>(context,
-                                             vk::Extent2D{
-                                                 1,
-                                                 1,
-                                             },
-                                             format,
-                                             color));
-    return index;
-}
 }  // namespace rendering
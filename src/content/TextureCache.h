@@ -2,23 +2,88 @@
 
 #include <map>
 #include <cstdint>
+#include <future>
+#include <string>
+#include <utility>
 #include <vector>
 #include <memory>
 #include <glm/vec4.hpp>
 #include "Image.h"
+#include "MeshCache.h"
+#include "TextureBaker.h"
 #include "tiny_gltf.h"
 
 namespace rendering {
 
+    // New textures start out with the first level whose larger side is at most this, feedback streams the rest in
+    constexpr uint32_t INITIAL_RESIDENT_TEXTURE_SIZE = 64;
+
+    // Size of the partially bound texture array of the scene, loading a file that would go past it fails
+    constexpr uint32_t MAX_SCENE_TEXTURES = 2048;
+
+    // A glTF texture index together with the way it's sampled, the same image may be baked differently per use
+    using TextureKey = std::pair<int32_t, TextureKind>;
+
+    // Every texture use referenced by the model's materials
+    std::vector<TextureKey> getMaterialTextures(const tinygltf::Model &model);
+
+    /*
+     * Image loader for tinygltf that keeps the encoded PNG or JPEG bytes and marks the image as_is. Decoding happens
+     * later on the worker that bakes the texture, and is skipped completely if the baked texture is cached.
+     */
+    bool storeEncodedGLTFImage(tinygltf::Image *image,
+                               int imageIndex,
+                               std::string *err,
+                               std::string *warn,
+                               int requestedWidth,
+                               int requestedHeight,
+                               const unsigned char *bytes,
+                               int size,
+                               void *userData);
+
+    struct BakedGLTFTexture {
+        // Identifies the texels and bake parameters, equal keys mean interchangeable textures even across files
+        uint64_t contentKey = 0;
+        BakedTexture texture;
+    };
+
+    /*
+     * Registry of every image bound to the scene. Textures are shared by content, so a texture used by several files
+     * only gets one image.
+     */
     class TextureCache {
     public:
-        std::map<uint32_t, int32_t> loadedTextureIndices;
+        // Texture uses of the current file that have already been resolved
+        std::map<TextureKey, int32_t> loadedTextureIndices;
         std::vector<std::unique_ptr<Image>> images;
+        /*
+         * Full mip chain of every image, mostly mapped cache files. The image only holds the levels from the resident
+         * level on.
+         */
+        std::vector<BakedTexture> sources;
+        std::vector<uint32_t> residentLevels;
+
+        /*
+         * Bakes one texture use on the calling thread, reusing the file next to the model's mesh cache entries if it's
+         * still valid
+         */
+        static BakedGLTFTexture bakeGLTFTexture(MeshCache &meshCache,
+                                            const std::string &modelPath,
+                                            const tinygltf::Model &model,
+                                            TextureKey key,
+                                            bool compress);
+
+        int32_t loadImage(VulkanContext &context, const tinygltf::Model &model, int32_t textureIndex, TextureKind kind);
 
-        int32_t loadImage(VulkanContext &context, const tinygltf::Model &model, int32_t textureIndex, vk::Format format = vk::Format::eR8G8B8A8Unorm);
-        int32_t create1x1Texture(VulkanContext &context, uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha, vk::Format format = vk::Format::eR8G8B8A8Unorm);
+        // Starts the next glTF file, loadImage takes the textures from bakedTextures and only bakes missing ones itself
+        void nextModel(const std::string &modelPath,
+                       std::map<TextureKey, std::future<BakedGLTFTexture>> bakedTextures = {});
 
-        void nextModel();
+    private:
+        // Named in the error of a file that has more textures than the scene has room for
+        std::string currentModelPath;
+        std::map<TextureKey, std::future<BakedGLTFTexture>> pendingTextures;
+        std::map<uint64_t, int32_t> contentIndices;
     };
 
 } // rendering
@@ -0,0 +1,119 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "UploadManager.h"
+
+namespace rendering {
+
+TextureStreamer::TextureStreamer(VulkanContext &context) {
+    const auto size = MAX_SCENE_TEXTURES * sizeof(int32_t);
+    feedbackBuffer = std::make_unique<Buffer>(
+        context, size, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc);
+    readbackBuffer = std::make_unique<Buffer>(
+        context, size, vk::BufferUsageFlagBits::eTransferDst, nullptr, MemoryClass::Readback);
+
+    context.uploads->record([&](vk::CommandBuffer cmd) {
+        cmd.fillBuffer(*feedbackBuffer->buffer, 0, VK_WHOLE_SIZE, NO_TEXTURE_REQUEST);
+    });
+    const std::vector<int32_t> noRequests(MAX_SCENE_TEXTURES, NO_TEXTURE_REQUEST);
+    readbackBuffer->updateData(context, size, noRequests.data());
+}
+
+void TextureStreamer::recordReadback(vk::CommandBuffer commandBuffer) const {
+    const vk::MemoryBarrier shaderWriteBarrier{
+        vk::AccessFlagBits::eShaderWrite,
+        vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite,
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                                  vk::PipelineStageFlagBits::eTransfer,
+                                  {},
+                                  shaderWriteBarrier,
+                                  {},
+                                  {});
+
+    const vk::BufferCopy region{0, 0, MAX_SCENE_TEXTURES * sizeof(int32_t)};
+    commandBuffer.copyBuffer(*feedbackBuffer->buffer, *readbackBuffer->buffer, region);
+    // The copy and the fill only touch the feedback buffer in turn, so they need an execution dependency
+    const vk::MemoryBarrier copyBarrier{vk::AccessFlagBits::eTransferRead, vk::AccessFlagBits::eTransferWrite};
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, copyBarrier, {}, {});
+    commandBuffer.fillBuffer(*feedbackBuffer->buffer, 0, VK_WHOLE_SIZE, NO_TEXTURE_REQUEST);
+
+    const vk::MemoryBarrier resetBarrier{
+        vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlagBits::eHostRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+    };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eHost | vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                                  {},
+                                  resetBarrier,
+                                  {},
+                                  {});
+}
+
+bool TextureStreamer::update(VulkanContext &context, TextureCache &textureCache) {
+    frame++;
+    const auto count = textureCache.images.size();
+    if (count == 0) {
+        return false;
+    }
+    std::vector<int32_t> requests(count);
+    readbackBuffer->readData(context, count * sizeof(int32_t), requests.data());
+    lastRequestFrames.resize(count, 0);
+
+    auto targetLevels = textureCache.residentLevels;
+    uint32_t upgrades = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (requests[i] == NO_TEXTURE_REQUEST) {
+            continue;
+        }
+        lastRequestFrames[i] = frame;
+        const auto lastLevel = static_cast<int64_t>(textureCache.sources[i].mipLevels()) - 1;
+        const auto requestedLevel = static_cast<uint32_t>(
+            std::clamp(static_cast<int64_t>(textureCache.residentLevels[i]) + requests[i], int64_t{0}, lastLevel));
+        // Textures are only made finer here, the budget decides which ones get coarser
+        if (requestedLevel < targetLevels[i] && upgrades < MAX_TEXTURE_UPGRADES_PER_FRAME) {
+            targetLevels[i] = requestedLevel;
+            upgrades++;
+        }
+    }
+
+    uint64_t residentSize = 0;
+    for (size_t i = 0; i < count; i++) {
+        residentSize += textureCache.sources[i].levelsSize(targetLevels[i]);
+    }
+    if (residentSize > budget) {
+        // Textures requested this frame come last, so they only lose levels if the rest can't free enough
+        std::vector<size_t> order(count);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return lastRequestFrames[a] < lastRequestFrames[b];
+        });
+        for (const auto i : order) {
+            const auto &source = textureCache.sources[i];
+            while (residentSize > budget && targetLevels[i] + 1 < source.mipLevels()) {
+                residentSize -= source.levelsSize(targetLevels[i]) - source.levelsSize(targetLevels[i] + 1);
+                targetLevels[i]++;
+            }
+            if (residentSize <= budget) {
+                break;
+            }
+        }
+    }
+
+    bool changed = false;
+    for (size_t i = 0; i < count; i++) {
+        if (targetLevels[i] == textureCache.residentLevels[i]) {
+            continue;
+        }
+        // The GPU is idle, so the previous image can go right away
+        textureCache.images[i] = std::make_unique<Image>(context, textureCache.sources[i], targetLevels[i]);
+        textureCache.residentLevels[i] = targetLevels[i];
+        changed = true;
+    }
+    return changed;
+}
+
+}  // namespace rendering
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Buffer.h"
+#include "TextureCache.h"
+
+namespace rendering {
+
+    constexpr uint64_t DEFAULT_TEXTURE_BUDGET = 1024ull * 1024 * 1024;
+    // Limits the uploads a single frame can cause, coarser levels are never limited since they only free memory
+    constexpr uint32_t MAX_TEXTURE_UPGRADES_PER_FRAME = 8;
+    // Feedback value of a texture no ray has sampled
+    constexpr int32_t NO_TEXTURE_REQUEST = 0x7FFFFFFF;
+
+    /*
+     * Decides which mip levels of the scene textures are resident. The hit shaders write the finest level they wanted
+     * from each texture into the feedback buffer, relative to the first resident level. After every frame the requests
+     * are read back, requested levels are streamed in and the least recently requested textures are dropped to
+     * coarser levels while the resident levels don't fit the budget.
+     */
+    class TextureStreamer {
+    public:
+        std::unique_ptr<Buffer> feedbackBuffer;
+        // Bytes the resident levels of all scene textures may take
+        uint64_t budget = DEFAULT_TEXTURE_BUDGET;
+
+        explicit TextureStreamer(VulkanContext &context);
+
+        // Copies the requests of the frame to the readback buffer and resets them for the next one
+        void recordReadback(vk::CommandBuffer commandBuffer) const;
+
+        /*
+         * Applies the requests of the last finished frame, the GPU has to be idle. Returns whether any image was
+         * replaced, in which case the texture descriptors have to be rewritten.
+         */
+        bool update(VulkanContext &context, TextureCache &textureCache);
+
+    private:
+        std::unique_ptr<Buffer> readbackBuffer;
+        std::vector<uint64_t> lastRequestFrames;
+        uint64_t frame = 0;
+    };
+
+}  // namespace rendering
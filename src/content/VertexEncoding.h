@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <glm/gtc/packing.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace rendering {
+
+    // Octahedral mapping of a direction to two snorm16 components, decoded by octahedralDecode in shaders/rt/vertex.glsl
+    inline uint32_t encodeOctahedral(const glm::vec3 &direction) {
+        const auto length = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+        if (length == 0.0f) {
+            return 0;
+        }
+        auto projected = glm::vec2(direction.x, direction.y) / length;
+        if (direction.z < 0.0f) {
+            // The lower hemisphere is folded over the diagonals
+            projected = glm::vec2((1.0f - std::abs(projected.y)) * (projected.x >= 0.0f ? 1.0f : -1.0f),
+                                  (1.0f - std::abs(projected.x)) * (projected.y >= 0.0f ? 1.0f : -1.0f));
+        }
+        return glm::packSnorm2x16(projected);
+    }
+
+    // Same as the normal, but the lowest bit is replaced with the bitangent sign (set for -1)
+    inline uint32_t encodeTangent(const glm::vec3 &tangent, float bitangentSign) {
+        return (encodeOctahedral(tangent) & ~1u) | (bitangentSign < 0.0f ? 1u : 0u);
+    }
+
+    inline uint32_t encodeUV(const glm::vec2 &uv) {
+        return glm::packHalf2x16(uv);
+    }
+
+}  // namespace rendering
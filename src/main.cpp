@@ -7,12 +7,18 @@
 #include <vulkan/vulkan.hpp>
 #include <fstream>
 #include <filesystem>
+#include <algorithm>
+#include <chrono>
 
 #include "ComputePass.h"
 #include "DescriptorSetAllocator.h"
 #include "GLFW/glfw3.h"
 #include "ProcessingPipeline.h"
 #include "Scene.h"
+#include "SceneDescription.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include "UploadManager.h"
 #include "Window.h"
 
 #define GLM_ENABLE_EXPERIMENTAL
@@ -34,11 +40,36 @@ struct Uniforms {
 
 float cameraSpeed = 3.0f;
 
+// Time a frame may spend merging streamed files, publishing them afterwards adds the BLAS and TLAS builds on top
+constexpr auto STREAMING_MERGE_BUDGET = std::chrono::milliseconds(4);
+
 void scrollCallback(GLFWwindow *window, double xoff, double yoff) {
     cameraSpeed *= std::pow(2.0f, static_cast<float>(yoff) / 50.0f);
 }
 
-int main() {
+int main(int argc, char **argv) {
+    // With --stream the first frame renders an empty scene and the files show up as they finish loading
+    const bool streaming = std::find(argv + 1, argv + argc, std::string("--stream")) != argv + argc;
+    // --texture-budget <MiB> limits the memory of the resident texture levels
+    uint64_t textureBudget = rendering::DEFAULT_TEXTURE_BUDGET;
+    if (const auto arg = std::find(argv + 1, argv + argc, std::string("--texture-budget")); arg + 1 < argv + argc) {
+        textureBudget = std::stoull(*(arg + 1)) * 1024 * 1024;
+    }
+    // --trace <path> records the startup phases and writes them as a Chrome trace once the scene is complete
+    std::string tracePath;
+    if (const auto arg = std::find(argv + 1, argv + argc, std::string("--trace")); arg + 1 < argv + argc) {
+        tracePath = *(arg + 1);
+        rendering::enableTracing();
+    }
+    const auto finishTrace = [&]() {
+        if (!tracePath.empty()) {
+            rendering::writeChromeTrace(tracePath);
+            rendering::printTraceSummary();
+            // The per-frame scopes would keep growing the trace for the rest of the session
+            rendering::disableTracing();
+        }
+    };
+
     rendering::Window window("Diplomaterv RT");
     rendering::VulkanContext context(window);
     std::filesystem::current_path("../");
@@ -47,23 +78,38 @@ int main() {
     poolSizeInfos.push_back({.type = vk::DescriptorType::eStorageImage, .ratio = 0.3f});
     poolSizeInfos.push_back({.type = vk::DescriptorType::eStorageBuffer, .ratio = 0.3f});
     poolSizeInfos.push_back({.type = vk::DescriptorType::eUniformBuffer, .ratio = 0.2f});
-    poolSizeInfos.push_back({.type = vk::DescriptorType::eCombinedImageSampler, .ratio = 0.1f});
+    // Every ray tracing pass reserves MAX_SCENE_TEXTURES samplers for the scene, twice while the pipeline is reloading
+    poolSizeInfos.push_back({.type = vk::DescriptorType::eCombinedImageSampler, .ratio = 8.0f});
     poolSizeInfos.push_back({.type = vk::DescriptorType::eAccelerationStructureKHR, .ratio = 0.1f});
     rendering::DescriptorSetAllocator descriptorSetAllocator(context, 1024, poolSizeInfos);
 
     const auto scene = std::make_shared<rendering::Scene>();
-    std::ifstream sceneDescriptor("models/scene.txt");
-    for (std::string line; std::getline(sceneDescriptor, line);) {
-        scene->loadGLTF(context, "models/" + line, 0);
+    rendering::ThreadPool threadPool;
+    // The structured description wins, scene.txt is still read for existing setups
+    const auto loadRequests = rendering::loadSceneDescription(
+            std::filesystem::exists("models/scene.json") ? "models/scene.json" : "models/scene.txt");
+    const auto loadStart = std::chrono::high_resolution_clock::now();
+    if (streaming) {
+        scene->streamGLTFs(context, threadPool, loadRequests);
+    } else {
+        scene->loadGLTFs(context, threadPool, loadRequests);
     }
 
     scene->build(context);
+    scene->textureStreamer->budget = textureBudget;
 
-    rendering::Buffer uniforms(context, sizeof(Uniforms), vk::BufferUsageFlagBits::eUniformBuffer);
-    rendering::Buffer uniformsSwap(context, sizeof(Uniforms), vk::BufferUsageFlagBits::eUniformBuffer);
+    rendering::Buffer uniforms(
+            context, sizeof(Uniforms), vk::BufferUsageFlagBits::eUniformBuffer, nullptr, rendering::MemoryClass::Dynamic
+    );
+    rendering::Buffer uniformsSwap(
+            context, sizeof(Uniforms), vk::BufferUsageFlagBits::eUniformBuffer, nullptr, rendering::MemoryClass::Dynamic
+    );
 
     rendering::ProcessingPipeline processingPipeline("models/pipeline.json", scene);
     processingPipeline.build(context, descriptorSetAllocator, window.getSize());
+    if (!streaming) {
+        finishTrace();
+    }
 
     glm::vec3 position(0.0f, 0.5f, -2.0f);
     float yaw = 0.0f;
@@ -81,6 +127,29 @@ int main() {
     auto countedFrames = 0;
 
     while (window.update()) {
+        // The previous frame has finished on the GPU, so the scene can be rebuilt safely
+        bool sceneChanged = scene->textureStreamer->update(context, scene->textureCache);
+        bool streamingFinished = false;
+        if (scene->isStreaming() && scene->updateStreaming(context, STREAMING_MERGE_BUDGET)) {
+            sceneChanged = true;
+            if (!scene->isStreaming()) {
+                std::cout << "Scene finished streaming after "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(
+                                     std::chrono::high_resolution_clock::now() - loadStart).count()
+                          << " ms\n";
+                streamingFinished = true;
+            }
+        }
+        // Animated objects are moved and deformed in place, then refit into the TLAS, that doesn't need new descriptors
+        scene->animate(context, static_cast<float>(glfwGetTime()));
+        scene->updateTransforms(context);
+        if (sceneChanged) {
+            processingPipeline.updateScene(context);
+        }
+        if (streamingFinished) {
+            finishTrace();
+        }
+
         // Inputs
         int reloadKeyState = glfwGetKey(window.handle, GLFW_KEY_R) == GLFW_PRESS;
         if (reloadKeyState == GLFW_PRESS) {
@@ -183,6 +252,7 @@ int main() {
         );
 
         processingPipeline.dispatch(*frame.commandBuffer);
+        scene->textureStreamer->recordReadback(*frame.commandBuffer);
 
         rendering::VulkanContext::transitionImage(
                 *frame.commandBuffer,
@@ -265,6 +335,8 @@ int main() {
                 signalInfo,
         };
 
+        // Uploads recorded this frame have to be submitted ahead of the frame that uses them
+        context.uploads->flush();
         context.queue.submit2({submitInfo}, *frame.renderFence);
         context.queue.waitIdle();
 
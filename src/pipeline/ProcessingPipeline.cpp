@@ -3,6 +3,7 @@
 #include <fstream>
 
 #include "RaytracePass.h"
+#include "Trace.h"
 #include "expression_parsing.h"
 #include "json.hpp"
 
@@ -108,6 +109,7 @@ namespace rendering {
     }
 
     void ProcessingPipeline::build(VulkanContext &context, DescriptorSetAllocator &allocator, vk::Extent2D screenSize) {
+        TRACE_SCOPE("Build processing pipeline");
         std::vector<vk::DescriptorSetLayoutBinding> uniformBindings = {
                 {0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eAll},
                 {1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eAll}
@@ -189,6 +191,12 @@ namespace rendering {
         }
     }
 
+    void ProcessingPipeline::updateScene(const VulkanContext &context) {
+        for (const auto &pass: passes) {
+            pass->updateScene(context);
+        }
+    }
+
     void ProcessingPipeline::dispatch(vk::CommandBuffer commandBuffer) {
         for (size_t i = 0; i < passes.size(); i++) {
             passes[i]->dispatch(
@@ -21,6 +21,9 @@ namespace rendering {
 
         void dispatch(vk::CommandBuffer commandBuffer);
 
+        // Rewrites the scene descriptors of every pass after the scene published new files
+        void updateScene(const VulkanContext &context);
+
         template<typename T>
         inline void
         updateUniforms(const VulkanContext &context, const vk::Buffer &uniforms, const vk::Buffer &prevUniforms) {
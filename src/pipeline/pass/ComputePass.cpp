@@ -3,6 +3,7 @@
 #include <utility>
 
 #include "Image.h"
+#include "Trace.h"
 #include "util.h"
 
 namespace rendering {
@@ -18,6 +19,7 @@ namespace rendering {
             DescriptorSetAllocator &descriptorSetAllocator,
             const vk::DescriptorSetLayout &uniformDescriptorSetLayout
     ) {
+        TRACE_SCOPE("Create compute pipeline");
         Pass::build(context, descriptorSetAllocator, uniformDescriptorSetLayout);
 
         std::vector<vk::DescriptorSetLayout> descriptorSetLayouts = {uniformDescriptorSetLayout, *descriptorSetLayout};
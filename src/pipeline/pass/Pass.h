@@ -27,6 +27,9 @@ namespace rendering {
                 uint32_t depth
         );
 
+        // Called after the scene has been rebuilt between frames, only passes binding the scene have to react
+        virtual void updateScene(const VulkanContext &context) {}
+
         void addInput(uint32_t binding, vk::DescriptorType type, uint32_t descriptorCount);
 
         void setInputImage(const VulkanContext &context, uint32_t binding, const rendering::Image &resource);
@@ -1,7 +1,9 @@
 #include "RaytracePass.h"
 
+#include <algorithm>
 #include <utility>
 
+#include "Trace.h"
 #include "util.h"
 
 namespace rendering {
@@ -24,6 +26,7 @@ namespace rendering {
             DescriptorSetAllocator &descriptorSetAllocator,
             const vk::DescriptorSetLayout &uniformDescriptorSetLayout
     ) {
+        TRACE_SCOPE("Create ray tracing pipeline");
         Pass::build(context, descriptorSetAllocator, uniformDescriptorSetLayout);
 
         std::vector<vk::UniqueShaderModule> shaders;
@@ -87,17 +90,26 @@ namespace rendering {
             );
         }
 
+        // The texture array is sized for the whole stream up front, so publishing files never changes the layout
         std::vector<vk::DescriptorSetLayoutBinding> sceneBindings = {
-                {0, vk::DescriptorType::eAccelerationStructureKHR, 1,                                                        vk::ShaderStageFlagBits::eAll},
-                {1, vk::DescriptorType::eStorageBuffer,            1,                                                        vk::ShaderStageFlagBits::eAll},
-                {2, vk::DescriptorType::eCombinedImageSampler,     static_cast<uint32_t>(scene->textureCache.images.size()), vk::ShaderStageFlagBits::eAll},
-                {3, vk::DescriptorType::eStorageBuffer,            1,                                                        vk::ShaderStageFlagBits::eAll},
+                {0, vk::DescriptorType::eAccelerationStructureKHR, 1,                  vk::ShaderStageFlagBits::eAll},
+                {1, vk::DescriptorType::eStorageBuffer,            1,                  vk::ShaderStageFlagBits::eAll},
+                {2, vk::DescriptorType::eCombinedImageSampler,     MAX_SCENE_TEXTURES, vk::ShaderStageFlagBits::eAll},
+                {3, vk::DescriptorType::eStorageBuffer,            1,                  vk::ShaderStageFlagBits::eAll},
+                {4, vk::DescriptorType::eStorageBuffer,            1,                  vk::ShaderStageFlagBits::eAll},
+                {5, vk::DescriptorType::eStorageBuffer,            1,                  vk::ShaderStageFlagBits::eAll},
+                {6, vk::DescriptorType::eStorageBuffer,            1,                  vk::ShaderStageFlagBits::eAll},
+                {7, vk::DescriptorType::eStorageBuffer,            1,                  vk::ShaderStageFlagBits::eAll},
         };
+        std::vector<vk::DescriptorBindingFlags> sceneBindingFlags(sceneBindings.size());
+        sceneBindingFlags[2] = vk::DescriptorBindingFlagBits::ePartiallyBound;
+        vk::DescriptorSetLayoutBindingFlagsCreateInfo sceneBindingFlagsInfo{sceneBindingFlags};
 
         sceneDescriptorSetLayout = context.device->createDescriptorSetLayoutUnique(
                 {
                         {},
-                        sceneBindings
+                        sceneBindings,
+                        &sceneBindingFlagsInfo
                 }
         );
 
@@ -114,38 +126,7 @@ namespace rendering {
                 }
         );
 
-        std::vector<vk::WriteDescriptorSet> writes(sceneBindings.size());
-        for (size_t i = 0; i < sceneBindings.size(); ++i) {
-            writes[i]
-                    .setDstSet(*sceneDescriptorSet)
-                    .setDescriptorType(sceneBindings[i].descriptorType)
-                    .setDescriptorCount(
-                            sceneBindings[i].descriptorCount
-                    )
-                    .setDstBinding(sceneBindings[i].binding);
-        }
-
-        vk::DescriptorBufferInfo descriptorBufferInfo{
-                *scene->objDescriptorBuffer->buffer,
-                {},
-                sizeof(rendering::ObjDesc) * scene->objects.size()
-        };
-        vk::DescriptorBufferInfo emissiveIdsInfo{
-                *scene->emissiveObjectIdsBuffer->buffer,
-                {},
-                sizeof(uint32_t) * scene->emissiveObjectIds.size()
-        };
-        std::vector<vk::DescriptorImageInfo> imageInfos;
-        for (const auto &image: scene->textureCache.images) {
-            imageInfos.emplace_back(*scene->sampler, *image->view, vk::ImageLayout::eGeneral);
-        }
-
-        writes[0].setPNext(&scene->accelerationStructure->accelInfo);
-        writes[1].setBufferInfo(descriptorBufferInfo);
-        writes[2].setImageInfo(imageInfos);
-        writes[3].setBufferInfo(emissiveIdsInfo);
-
-        context.device->updateDescriptorSets(writes, nullptr);
+        updateScene(context);
 
         vk::RayTracingPipelineCreateInfoKHR rayTracingPipelineCreateInfo{
                 {},
@@ -217,6 +198,45 @@ namespace rendering {
         rayHitRegion.deviceAddress = rayMissRegion.deviceAddress + rayMissRegion.size;
     }
 
+    void RaytracePass::updateScene(const VulkanContext &context) {
+        TRACE_SCOPE("Write scene descriptors");
+        if (scene->textureCache.images.size() > MAX_SCENE_TEXTURES) {
+            throw std::runtime_error("The scene has more textures than MAX_SCENE_TEXTURES");
+        }
+
+        vk::DescriptorBufferInfo instanceDescsInfo{*scene->instanceDescBuffer->buffer, {}, VK_WHOLE_SIZE};
+        vk::DescriptorBufferInfo geometryDescsInfo{*scene->geometryDescBuffer->buffer, {}, VK_WHOLE_SIZE};
+        vk::DescriptorBufferInfo emissiveIdsInfo{
+                *scene->emissiveObjectIdsBuffer->buffer,
+                {},
+                sizeof(uint32_t) * std::max<size_t>(scene->emissiveObjectIds.size(), 1)
+        };
+        vk::DescriptorBufferInfo geometryChunksInfo{*scene->geometryChunkBuffer->buffer, {}, VK_WHOLE_SIZE};
+        vk::DescriptorBufferInfo materialsInfo{*scene->materialBuffer->buffer, {}, VK_WHOLE_SIZE};
+        vk::DescriptorBufferInfo textureFeedbackInfo{*scene->textureStreamer->feedbackBuffer->buffer, {}, VK_WHOLE_SIZE};
+        std::vector<vk::DescriptorImageInfo> imageInfos;
+        for (const auto &image: scene->textureCache.images) {
+            imageInfos.emplace_back(*scene->sampler, *image->view, vk::ImageLayout::eGeneral);
+        }
+
+        std::vector<vk::WriteDescriptorSet> writes = {
+                {*sceneDescriptorSet, 0, 0, 1, vk::DescriptorType::eAccelerationStructureKHR},
+                {*sceneDescriptorSet, 1, 0, vk::DescriptorType::eStorageBuffer, {}, instanceDescsInfo},
+                {*sceneDescriptorSet, 3, 0, vk::DescriptorType::eStorageBuffer, {}, emissiveIdsInfo},
+                {*sceneDescriptorSet, 4, 0, vk::DescriptorType::eStorageBuffer, {}, geometryChunksInfo},
+                {*sceneDescriptorSet, 5, 0, vk::DescriptorType::eStorageBuffer, {}, materialsInfo},
+                {*sceneDescriptorSet, 6, 0, vk::DescriptorType::eStorageBuffer, {}, textureFeedbackInfo},
+                {*sceneDescriptorSet, 7, 0, vk::DescriptorType::eStorageBuffer, {}, geometryDescsInfo},
+        };
+        writes[0].setPNext(&scene->accelerationStructure->accelInfo);
+        // Only the textures loaded so far are written, the rest of the array stays unbound
+        if (!imageInfos.empty()) {
+            writes.emplace_back(*sceneDescriptorSet, 2, 0, vk::DescriptorType::eCombinedImageSampler, imageInfos);
+        }
+
+        context.device->updateDescriptorSets(writes, nullptr);
+    }
+
     void RaytracePass::dispatch(
             vk::CommandBuffer commandBuffer,
             const vk::DescriptorSet &uniformDescriptorSet,
@@ -26,6 +26,9 @@ public:
                DescriptorSetAllocator &descriptorSetAllocator,
                const vk::DescriptorSetLayout &uniformDescriptorSetLayout) override;
 
+    // Points the scene descriptors at the current TLAS, buffers and textures of the scene
+    void updateScene(const VulkanContext &context) override;
+
     void dispatch(
             vk::CommandBuffer commandBuffer,
             const vk::DescriptorSet &uniformDescriptorSet,
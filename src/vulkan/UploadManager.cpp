@@ -0,0 +1,318 @@
+#include "UploadManager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "Trace.h"
+#include "VulkanContext.h"
+
+namespace rendering {
+
+namespace {
+
+uint64_t alignOffset(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+void transitionMipLevel(
+    vk::CommandBuffer cmd, vk::Image image, uint32_t mipLevel, vk::ImageLayout oldLayout, vk::ImageLayout newLayout) {
+    const vk::ImageMemoryBarrier2 barrier{
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferWrite,
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferRead,
+        oldLayout,
+        newLayout,
+        {},
+        {},
+        image,
+        {vk::ImageAspectFlagBits::eColor, mipLevel, 1, 0, 1},
+    };
+    cmd.pipelineBarrier2(vk::DependencyInfo{{}, {}, {}, barrier});
+}
+
+int32_t mipExtent(uint32_t extent, uint32_t mipLevel) {
+    return static_cast<int32_t>(std::max(extent >> mipLevel, 1u));
+}
+
+}  // namespace
+
+UploadManager::UploadManager(vk::Device device, vma::Allocator allocator, vk::Queue queue, uint32_t queueFamilyIndex)
+    : device(device), allocator(allocator), queue(queue) {
+    vk::SemaphoreTypeCreateInfo semaphoreTypeCreateInfo{vk::SemaphoreType::eTimeline, 0};
+    const vk::SemaphoreCreateInfo semaphoreCreateInfo{{}, &semaphoreTypeCreateInfo};
+    timeline = device.createSemaphoreUnique(semaphoreCreateInfo);
+
+    const vk::BufferCreateInfo ringCreateInfo{
+        {},
+        UPLOAD_RING_SIZE,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::SharingMode::eExclusive,
+    };
+    constexpr vma::AllocationCreateInfo ringAllocationCreateInfo{
+        vma::AllocationCreateFlagBits::eMapped | vma::AllocationCreateFlagBits::eHostAccessSequentialWrite,
+        vma::MemoryUsage::eAuto,
+    };
+    vma::AllocationInfo ringAllocationInfo;
+    auto [buffer, allocation] =
+        allocator.createBufferUnique(ringCreateInfo, ringAllocationCreateInfo, &ringAllocationInfo);
+    ringBuffer = std::move(buffer);
+    ringAllocation = std::move(allocation);
+    ringMapped = static_cast<uint8_t *>(ringAllocationInfo.pMappedData);
+
+    const vk::CommandPoolCreateInfo commandPoolCreateInfo{vk::CommandPoolCreateFlagBits::eTransient, queueFamilyIndex};
+    for (uint32_t i = 0; i < UPLOAD_BATCH_SLOTS; i++) {
+        BatchSlot slot;
+        slot.commandPool = device.createCommandPoolUnique(commandPoolCreateInfo);
+        const vk::CommandBufferAllocateInfo allocInfo{*slot.commandPool, vk::CommandBufferLevel::ePrimary, 1};
+        slot.commandBuffer = std::move(device.allocateCommandBuffersUnique(allocInfo).front());
+        slots.push_back(std::move(slot));
+    }
+}
+
+UploadManager::~UploadManager() {
+    waitIdle();
+}
+
+void UploadManager::uploadBuffer(vk::Buffer destination, vk::DeviceSize offset, const void *data, vk::DeviceSize size) {
+    TRACE_SCOPE("Stage buffer upload");
+    if (size == 0) {
+        return;
+    }
+    const auto staging = allocateStaging(size, 16);
+    writeStaging(staging, data, size);
+
+    const vk::BufferCopy region{staging.offset, offset, size};
+    currentCommandBuffer().copyBuffer(staging.buffer, destination, region);
+
+    batchBytes += size;
+    if (batchBytes >= UPLOAD_RING_SIZE / 4) {
+        flush();
+    }
+}
+
+void UploadManager::uploadImage(vk::Image image,
+                                vk::Extent2D extent,
+                                const void *data,
+                                vk::DeviceSize size,
+                                uint32_t mipLevels,
+                                vk::ImageLayout finalLayout) {
+    TRACE_SCOPE("Stage image upload");
+    const auto staging = allocateStaging(size, 16);
+    writeStaging(staging, data, size);
+
+    const vk::BufferImageCopy region{
+        staging.offset,
+        0,
+        0,
+        vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+        {},
+        vk::Extent3D{extent.width, extent.height, 1},
+    };
+    const auto cmd = currentCommandBuffer();
+    VulkanContext::transitionImage(cmd, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+    cmd.copyBufferToImage(staging.buffer, image, vk::ImageLayout::eTransferDstOptimal, region);
+
+    if (mipLevels > 1) {
+        // Every level is blitted from the previous one, which is switched to a source as soon as it's complete
+        for (uint32_t level = 1; level < mipLevels; level++) {
+            transitionMipLevel(
+                cmd, image, level - 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal);
+            const vk::Offset3D srcEnd{mipExtent(extent.width, level - 1), mipExtent(extent.height, level - 1), 1};
+            const vk::Offset3D dstEnd{mipExtent(extent.width, level), mipExtent(extent.height, level), 1};
+            const vk::ImageBlit blit{
+                {vk::ImageAspectFlagBits::eColor, level - 1, 0, 1},
+                {vk::Offset3D{0, 0, 0}, srcEnd},
+                {vk::ImageAspectFlagBits::eColor, level, 0, 1},
+                {vk::Offset3D{0, 0, 0}, dstEnd},
+            };
+            cmd.blitImage(image,
+                          vk::ImageLayout::eTransferSrcOptimal,
+                          image,
+                          vk::ImageLayout::eTransferDstOptimal,
+                          blit,
+                          vk::Filter::eLinear);
+        }
+        transitionMipLevel(
+            cmd, image, mipLevels - 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal);
+        VulkanContext::transitionImage(cmd, image, vk::ImageLayout::eTransferSrcOptimal, finalLayout);
+    } else {
+        VulkanContext::transitionImage(cmd, image, vk::ImageLayout::eTransferDstOptimal, finalLayout);
+    }
+
+    batchBytes += size;
+    if (batchBytes >= UPLOAD_RING_SIZE / 4) {
+        flush();
+    }
+}
+
+void UploadManager::uploadImageLevels(vk::Image image,
+                                      vk::Extent2D extent,
+                                      std::span<const uint8_t> data,
+                                      std::span<const vk::DeviceSize> levelOffsets,
+                                      vk::ImageLayout finalLayout) {
+    TRACE_SCOPE("Stage image upload");
+    const auto staging = allocateStaging(data.size(), 16);
+    writeStaging(staging, data.data(), data.size());
+
+    std::vector<vk::BufferImageCopy> regions;
+    for (uint32_t level = 0; level < levelOffsets.size(); level++) {
+        regions.push_back(vk::BufferImageCopy{
+            staging.offset + levelOffsets[level],
+            0,
+            0,
+            vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, level, 0, 1},
+            {},
+            vk::Extent3D{static_cast<uint32_t>(mipExtent(extent.width, level)),
+                         static_cast<uint32_t>(mipExtent(extent.height, level)),
+                         1},
+        });
+    }
+    const auto cmd = currentCommandBuffer();
+    VulkanContext::transitionImage(cmd, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+    cmd.copyBufferToImage(staging.buffer, image, vk::ImageLayout::eTransferDstOptimal, regions);
+    VulkanContext::transitionImage(cmd, image, vk::ImageLayout::eTransferDstOptimal, finalLayout);
+
+    batchBytes += data.size();
+    if (batchBytes >= UPLOAD_RING_SIZE / 4) {
+        flush();
+    }
+}
+
+void UploadManager::record(const std::function<void(vk::CommandBuffer)> &func) {
+    func(currentCommandBuffer());
+}
+
+void UploadManager::flush() {
+    if (!recording) {
+        return;
+    }
+    TRACE_SCOPE("Flush uploads");
+    auto &slot = slots[currentSlot];
+
+    const vk::MemoryBarrier2 barrier{
+        vk::PipelineStageFlagBits2::eAllCommands,
+        vk::AccessFlagBits2::eMemoryWrite,
+        vk::PipelineStageFlagBits2::eAllCommands,
+        vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite,
+    };
+    slot.commandBuffer->pipelineBarrier2(vk::DependencyInfo{{}, barrier});
+    slot.commandBuffer->end();
+
+    slot.timelineValue = ++submittedValue;
+    const vk::SemaphoreSubmitInfo signalInfo{
+        *timeline,
+        slot.timelineValue,
+        vk::PipelineStageFlagBits2::eAllCommands,
+        0,
+    };
+    const vk::CommandBufferSubmitInfo commandBufferSubmitInfo{*slot.commandBuffer, 0};
+    const vk::SubmitInfo2 submitInfo{
+        {},
+        {},
+        commandBufferSubmitInfo,
+        signalInfo,
+    };
+    queue.submit2(submitInfo);
+
+    pendingReleases.push_back({slot.timelineValue, ringHead});
+    recording = false;
+    batchBytes = 0;
+    currentSlot = (currentSlot + 1) % UPLOAD_BATCH_SLOTS;
+}
+
+void UploadManager::waitIdle() {
+    flush();
+    if (submittedValue > 0) {
+        waitForValue(submittedValue);
+    }
+    releaseCompleted(false);
+}
+
+vk::CommandBuffer UploadManager::currentCommandBuffer() {
+    auto &slot = slots[currentSlot];
+    if (!recording) {
+        // Slots are reused round robin, by the time we get back to one its batch has almost always finished
+        if (slot.timelineValue > 0) {
+            waitForValue(slot.timelineValue);
+        }
+        slot.overflowBuffers.clear();
+        device.resetCommandPool(*slot.commandPool);
+        slot.commandBuffer->begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+        recording = true;
+    }
+    return *slot.commandBuffer;
+}
+
+UploadManager::StagingAllocation UploadManager::allocateStaging(vk::DeviceSize size, vk::DeviceSize alignment) {
+    if (size > UPLOAD_RING_SIZE / 2) {
+        // Too large for the ring, give it a dedicated buffer that lives as long as the batch it's recorded into
+        const vk::BufferCreateInfo createInfo{
+            {},
+            size,
+            vk::BufferUsageFlagBits::eTransferSrc,
+            vk::SharingMode::eExclusive,
+        };
+        constexpr vma::AllocationCreateInfo allocationCreateInfo{
+            vma::AllocationCreateFlagBits::eMapped | vma::AllocationCreateFlagBits::eHostAccessSequentialWrite,
+            vma::MemoryUsage::eAuto,
+        };
+        vma::AllocationInfo allocationInfo;
+        auto overflow = allocator.createBufferUnique(createInfo, allocationCreateInfo, &allocationInfo);
+        const StagingAllocation staging{*overflow.first, *overflow.second, 0, allocationInfo.pMappedData};
+        currentCommandBuffer();
+        slots[currentSlot].overflowBuffers.push_back(std::move(overflow));
+        return staging;
+    }
+
+    auto start = alignOffset(ringHead, alignment);
+    if (start % UPLOAD_RING_SIZE + size > UPLOAD_RING_SIZE) {
+        // Allocations never wrap around the end of the ring
+        start = alignOffset(start, UPLOAD_RING_SIZE);
+    }
+    while (start + size - ringTail > UPLOAD_RING_SIZE) {
+        releaseCompleted(false);
+        if (ringTail == ringHead) {
+            // Everything has been released, restart from the beginning of the ring
+            start = ringTail = ringHead = alignOffset(ringHead, UPLOAD_RING_SIZE);
+            break;
+        }
+        if (start + size - ringTail <= UPLOAD_RING_SIZE) {
+            break;
+        }
+        if (pendingReleases.empty()) {
+            // The space is held by the batch being recorded
+            flush();
+        }
+        releaseCompleted(true);
+    }
+
+    ringHead = start + size;
+    return {*ringBuffer, *ringAllocation, start % UPLOAD_RING_SIZE, ringMapped + start % UPLOAD_RING_SIZE};
+}
+
+void UploadManager::writeStaging(const StagingAllocation &staging, const void *data, vk::DeviceSize size) {
+    std::memcpy(staging.mapped, data, size);
+    allocator.flushAllocation(staging.allocation, staging.offset, size);
+}
+
+void UploadManager::releaseCompleted(bool wait) {
+    if (wait && !pendingReleases.empty()) {
+        waitForValue(pendingReleases.front().timelineValue);
+    }
+    const auto completedValue = device.getSemaphoreCounterValue(*timeline);
+    while (!pendingReleases.empty() && pendingReleases.front().timelineValue <= completedValue) {
+        ringTail = pendingReleases.front().end;
+        pendingReleases.pop_front();
+    }
+}
+
+void UploadManager::waitForValue(uint64_t value) {
+    const vk::SemaphoreWaitInfo waitInfo{{}, *timeline, value};
+    if (device.waitSemaphores(waitInfo, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess) {
+        throw std::runtime_error("Failed to wait for uploads");
+    }
+}
+
+}  // namespace rendering
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include <vk_mem_alloc.hpp>
+#include <vulkan/vulkan.hpp>
+
+namespace rendering {
+
+    constexpr vk::DeviceSize UPLOAD_RING_SIZE = 64 * 1024 * 1024;
+    constexpr uint32_t UPLOAD_BATCH_SLOTS = 4;
+
+    /*
+     * Streams data to the GPU through a persistently mapped staging ring. Copies are recorded into batches that get
+     * submitted once they grow large enough (or on flush()) and completion is tracked with a timeline semaphore, so the
+     * CPU only waits when the ring runs out of space. Every batch ends with a global barrier, work submitted to the
+     * queue after a flush can use the uploaded data without any further synchronization.
+     *
+     * Not thread safe, it's meant to be used from the thread that owns the queue.
+     */
+    class UploadManager {
+    public:
+        UploadManager(vk::Device device, vma::Allocator allocator, vk::Queue queue, uint32_t queueFamilyIndex);
+
+        ~UploadManager();
+
+        UploadManager(const UploadManager &) = delete;
+
+        UploadManager &operator=(const UploadManager &) = delete;
+
+        void uploadBuffer(vk::Buffer destination, vk::DeviceSize offset, const void *data, vk::DeviceSize size);
+
+        /*
+         * Copies tightly packed texel data into the first mip level, fills the rest of the chain by successive linear
+         * blits and leaves the image in finalLayout
+         */
+        void uploadImage(vk::Image image,
+                         vk::Extent2D extent,
+                         const void *data,
+                         vk::DeviceSize size,
+                         uint32_t mipLevels = 1,
+                         vk::ImageLayout finalLayout = vk::ImageLayout::eGeneral);
+
+        // Copies a complete, precomputed mip chain (e.g. block compressed levels) starting at the given offsets of data
+        void uploadImageLevels(vk::Image image,
+                               vk::Extent2D extent,
+                               std::span<const uint8_t> data,
+                               std::span<const vk::DeviceSize> levelOffsets,
+                               vk::ImageLayout finalLayout = vk::ImageLayout::eGeneral);
+
+        // Records arbitrary commands into the current batch, e.g. layout transitions of images without initial data
+        void record(const std::function<void(vk::CommandBuffer)> &func);
+
+        // Submits the current batch without waiting for it
+        void flush();
+
+        // Submits the current batch and blocks until every upload has finished
+        void waitIdle();
+
+    private:
+        struct StagingAllocation {
+            vk::Buffer buffer;
+            vma::Allocation allocation;
+            vk::DeviceSize offset;
+            void *mapped;
+        };
+
+        struct BatchSlot {
+            vk::UniqueCommandPool commandPool;
+            vk::UniqueCommandBuffer commandBuffer;
+            uint64_t timelineValue = 0;
+            // Staging buffers for uploads that don't fit into the ring, released when the slot is reused
+            std::vector<std::pair<vma::UniqueBuffer, vma::UniqueAllocation>> overflowBuffers;
+        };
+
+        // Ring space that becomes free once the batch signaling timelineValue completes
+        struct PendingRelease {
+            uint64_t timelineValue;
+            uint64_t end;
+        };
+
+        vk::Device device;
+        vma::Allocator allocator;
+        vk::Queue queue;
+        vk::UniqueSemaphore timeline;
+        uint64_t submittedValue = 0;
+
+        vma::UniqueBuffer ringBuffer;
+        vma::UniqueAllocation ringAllocation;
+        uint8_t *ringMapped = nullptr;
+        // Monotonic offsets, the physical position is the offset modulo the ring size
+        uint64_t ringHead = 0;
+        uint64_t ringTail = 0;
+        std::deque<PendingRelease> pendingReleases;
+
+        std::vector<BatchSlot> slots;
+        uint32_t currentSlot = 0;
+        bool recording = false;
+        vk::DeviceSize batchBytes = 0;
+
+        vk::CommandBuffer currentCommandBuffer();
+
+        StagingAllocation allocateStaging(vk::DeviceSize size, vk::DeviceSize alignment);
+
+        // The staging memory may not be host coherent, the written range is flushed before the copy is recorded
+        void writeStaging(const StagingAllocation &staging, const void *data, vk::DeviceSize size);
+
+        // Frees the ring space of finished batches, blocking until the oldest one is done if wait is set
+        void releaseCompleted(bool wait);
+
+        void waitForValue(uint64_t value);
+    };
+
+}  // namespace rendering
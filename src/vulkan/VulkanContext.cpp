@@ -1,12 +1,14 @@
 #include "VulkanContext.h"
 
 #include <algorithm>
+#include <iostream>
 #include <optional>
 #include <vector>
 
 #include <vulkan/vulkan.hpp>
 
 #include "glfw_include.h"
+#include "UploadManager.h"
 
 
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
@@ -87,11 +89,18 @@ namespace rendering {
         vulkan12Features.setUniformAndStorageBuffer8BitAccess(true)
                 .setShaderSampledImageArrayNonUniformIndexing(true)
                 .setRuntimeDescriptorArray(true)
+                .setDescriptorBindingPartiallyBound(true)
                 .setScalarBlockLayout(true)
+                .setTimelineSemaphore(true)
                 .setBufferDeviceAddress(true);
         vk::PhysicalDeviceVulkan11Features vulkan11Features;
         vulkan11Features.setStorageBuffer16BitAccess(true).setUniformAndStorageBuffer16BitAccess(true);
+        textureCompressionBC = physicalDevice.getFeatures().textureCompressionBC;
+        if (!textureCompressionBC) {
+            std::cout << "BC texture compression isn't supported, textures will be uploaded uncompressed\n";
+        }
         vk::PhysicalDeviceFeatures vulkan10Features{};
+        vulkan10Features.setTextureCompressionBC(textureCompressionBC);
         vk::PhysicalDeviceFeatures2 features{
                 vulkan10Features,
         };
@@ -164,11 +173,16 @@ namespace rendering {
                 {},
                 {},
                 instance.get(),
+                VK_API_VERSION_1_3,
         };
 
         allocator = vma::createAllocatorUnique(allocatorCreateInfo);
+
+        uploads = std::make_unique<UploadManager>(*device, *allocator, queue, queueFamily.value());
     }
 
+    VulkanContext::~VulkanContext() = default;
+
     std::vector<const char *> VulkanContext::getGLFWExtensions() {
         uint32_t glfwExtensionCount;
         const char **glfwExtensionsRaw = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
@@ -200,6 +214,9 @@ namespace rendering {
 
     void
     VulkanContext::createAndSubmitCommandBuffer(const std::function<void(vk::CommandBuffer)> &func, bool waitIdle) {
+        // Pending uploads have to land before anything recorded here reads them
+        uploads->flush();
+
         immediateCommandBuffer->reset();
         vk::CommandBufferBeginInfo beginInfo{
                 vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
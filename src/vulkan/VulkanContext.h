@@ -3,6 +3,7 @@
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 
 #include <functional>
+#include <memory>
 
 #include "Window.h"
 #include <vk_mem_alloc.hpp>
@@ -12,6 +13,8 @@ namespace rendering {
 
     constexpr uint32_t FRAMES_IN_FLIGHT = 3;
 
+    class UploadManager;
+
     struct Frame {
         vk::UniqueCommandPool commandPool;
         vk::UniqueCommandBuffer commandBuffer;
@@ -30,9 +33,14 @@ namespace rendering {
         vk::UniqueSwapchainKHR swapchain;
         std::vector<vk::Image> swapchainImages;
         vma::UniqueAllocator allocator;
+        std::unique_ptr<UploadManager> uploads;
+        // Textures are baked to BC formats when set, otherwise they stay uncompressed
+        bool textureCompressionBC = false;
 
         explicit VulkanContext(const Window &window);
 
+        ~VulkanContext();
+
         VulkanContext(const VulkanContext &) = delete;
 
         VulkanContext &operator=(const VulkanContext &) = delete;